@@ -0,0 +1,721 @@
+//
+// Simulated IO-Warrior kit library, drop-in replacement for iowkit.o
+// to compile: linked instead of iowkit.o by the Makefile 'bench' target
+//
+// Every simulated USB stick carries one SHTC1/SHTW1 sensor at I2C address 0x70.
+// Environment variables:
+// IOWKIT_SIM_DEVICES     number of simulated sticks, serial numbers (dec) 10001, 10002, ...
+//                        when not set, the three sticks from the shipped configuration file are simulated
+// IOWKIT_SIM_LATENCY_US  USB round trip time of every special mode report in microseconds, a comma separated list gives
+//                        the sticks different times, e.g. sticks on different hubs: "100,800" alternates between 100 and 800
+// IOWKIT_SIM_FAULT_RATE  faults per 1000 I2C transactions: NACK, T or RH checksum error, lost reply report,
+//                        sensor hang cleared by a soft reset, bus hang cleared only by disabling I2C
+// IOWKIT_SIM_STALL_RATE  stalls per 1000 I2C transactions, the reply read blocks until IowKitCancelIo: transient stall of one
+//                        transaction, stick stall cleared only by disabling I2C, device stall cleared only by IowKitCloseDevice
+// IOWKIT_SIM_PRODUCT_ID  product ID of the simulated sticks, default IOW24 (0x1501), an IOW56 (0x1503) takes the I2C clock
+//                        from the enable report and spends the bus time of every transfer at that clock
+// IOWKIT_SIM_SHT3X       when set, every stick also carries an SHT3x at I2C address 0x44 with single shot and periodic modes
+// IOWKIT_SIM_CONTROLLERS number of USB host controllers, default 1, the hubs (or the sticks on root ports) are dealt to them in turn
+// IOWKIT_SIM_HUB_SIZE    sticks behind one external hub, default 0 = every stick on a root port of its controller
+// IOWKIT_SIM_HUB_SLOTS   report round trips a hub carries at once, further ones wait for a free slot, the root hub of a
+//                        controller counts as a hub; default 0 = not limited
+// IOWKIT_SIM_SYSFS       directory the simulated USB topology is written to, laid out like /sys/bus/usb/devices:
+//                        usb<bus> root hubs, <bus>-<port> hubs and <bus>-<port>.<port> sticks with their attributes
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "iowkit.h"
+
+#define SIM_SERIAL_NUMBER_BASE 10001 // serial number (dec) of the first stick when IOWKIT_SIM_DEVICES is set
+#define SIM_SENSOR_ADDRESS 0x70 // SHTC1/SHTW1 7bit I2C address
+#define SIM_SENSOR_ID 0x0807 // content of SHTC1 ID register, bits 5 to 0 are 000111
+#define SIM_CONVERSION_TIME_US 12100 // typical conversion time in normal mode, SHTC1 datasheet
+#define SIM_CONVERSION_TIME_LOW_POWER_US 800 // typical conversion time in low power mode, SHTC1 datasheet
+#define SIM_DEFAULT_TIMEOUT_MS 1000 // IowKitRead timeout when the caller did not set one
+#define SIM_CRC_POLYNOMIAL 0x131
+#define SIM_BITS_PER_BYTE 9 // 8 data bits and the acknowledge bit on the I2C bus
+#define SIM_SHT3X_ADDRESS 0x44 // SHT3x 7bit I2C address with ADDR pin low
+#define SIM_SHT3X_CONVERSION_TIME_US 12500 // typical conversion time with high repeatability, SHT3x datasheet
+#define SIM_SHT3X_CONVERSION_TIME_LOW_US 2500 // typical conversion time with low repeatability, SHT3x datasheet
+#define SIM_PORT_PATH_LENGTH 64 // sysfs name of a simulated stick, "<bus>-<port>.<port>"
+#define SIM_ROOT_HUB_VENDOR_ID 0x1d6b // vendor ID of the Linux root hubs
+#define SIM_HUB_VENDOR_ID 0x05e3 // vendor ID of the simulated external hubs
+
+enum SIM_FAULT
+{
+	SIM_FAULT_NACK = 0,
+	SIM_FAULT_T_CRC,
+	SIM_FAULT_RH_CRC,
+	SIM_FAULT_LOST_REPLY,
+	SIM_FAULT_SENSOR_HANG,	// every command but the soft reset is not acknowledged
+	SIM_FAULT_BUS_HANG,	// nothing is acknowledged until I2C is disabled
+	SIM_NUMBER_OF_FAULTS
+};
+
+enum SIM_STALL
+{
+	SIM_STALL_TRANSIENT = 0,	// only the reply of the current transaction never arrives
+	SIM_STALL_STICK,	// every reply read blocks until I2C is disabled
+	SIM_STALL_DEVICE,	// every reply read blocks until the devices are closed
+	SIM_NUMBER_OF_STALLS
+};
+
+typedef struct SIM_HUB
+{
+	unsigned long busy; // round trips in flight
+	pthread_mutex_t mutex;
+	pthread_cond_t free;
+} SIM_HUB;
+
+typedef struct SIM_DEVICE
+{
+	uint32_t serial_number;
+	int i2c_enabled;
+	int reply_pending;
+	IOWKIT_SPECIAL_REPORT reply;
+	uint16_t last_command;
+	int measuring;
+	struct timespec conversion_start;
+	unsigned int random_state;
+	int fault; // fault injected into the current transaction, -1 = none
+	int hang; // SIM_FAULT_SENSOR_HANG or SIM_FAULT_BUS_HANG in progress, -1 = none
+	int stall; // SIM_STALL in progress, -1 = none
+	int cancelled; // IowKitCancelIo called during a stalled read
+	unsigned long timeout_ms;
+	unsigned long i2c_clock_khz; // IOW56 only, 0 = the bus time is not simulated
+	unsigned long latency_us; // USB round trip time of a special mode report
+	uint16_t sht3x_command; // last command of the SHT3x, 0 = nothing to read
+	int sht3x_measuring;
+	struct timespec sht3x_conversion_start;
+	double sht3x_interval; // periodic mode measurement interval in seconds, 0 = single shot mode
+	struct timespec sht3x_periodic_start;
+	unsigned long sht3x_fetched; // periodic measurements already fetched
+	SIM_HUB * hub; // the stick is plugged in
+	char port_path[SIM_PORT_PATH_LENGTH];
+	pthread_mutex_t mutex;
+	pthread_cond_t cancel;
+} SIM_DEVICE;
+
+static SIM_DEVICE * sim_devices = NULL;
+static unsigned long sim_number_of_devices = 0;
+static unsigned long sim_fault_rate = 0;
+static unsigned long sim_stall_rate = 0;
+static unsigned long sim_product_id = IOWKIT_PRODUCT_ID_IOW24;
+static int sim_sht3x = 0;
+static SIM_HUB * sim_hubs = NULL;
+static unsigned long sim_number_of_hubs = 0;
+static unsigned long sim_hub_slots = 0;
+static struct timespec sim_start;
+
+static const uint32_t sim_default_serial_numbers[] = {6873, 6181, 6367};
+static const unsigned long sim_iow56_clocks_khz[] = {100, 400, 50, 1000}; // by the clock code in Bytes[2] of the enable report
+static const uint16_t sim_sht3x_periodic_commands[] = {0x2032, 0x202F, 0x2130, 0x212D, 0x2236, 0x2229, 0x2334, 0x232A, 0x2737, 0x272A};
+static const double sim_sht3x_periodic_intervals[] = {2.0, 2.0, 1.0, 1.0, 0.5, 0.5, 0.25, 0.25, 0.1, 0.1};
+
+static double SimElapsed(struct timespec since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - since.tv_sec) + (double)(now.tv_nsec - since.tv_nsec) / 1000000000;
+}
+
+static uint8_t SimChecksum(uint8_t data[], uint8_t bytes_count)
+{
+	uint8_t crc = 0xFF;
+	uint8_t bit_counter, byte_counter;
+
+	for (byte_counter = 0; byte_counter < bytes_count; byte_counter++)
+	{
+		crc ^= data[byte_counter];
+		for (bit_counter = 8; bit_counter > 0; --bit_counter)
+		{
+			if (crc & 0x80) crc = (crc << 1) ^ SIM_CRC_POLYNOMIAL;
+			else crc = (crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void SimPutWord(uint8_t bytes[], uint16_t word)
+{
+	bytes[0] = (uint8_t)(word >> 8);
+	bytes[1] = (uint8_t)(word & 0xFF);
+	bytes[2] = SimChecksum(bytes, 2);
+}
+
+static void SimMeasure(SIM_DEVICE * device, uint16_t * temperature_raw, uint16_t * humidity_raw)
+{
+	// slow drift around room conditions, different phase for every stick, plus a bit of noise
+	double t = SimElapsed(sim_start);
+	double phase = (double)(device - sim_devices);
+	double noise = (double)rand_r(&device->random_state) / RAND_MAX - 0.5;
+	double temperature = 22.0 + 2.0 * sin(t / 60.0 + phase) + 0.05 * noise;
+	double humidity = 45.0 + 10.0 * cos(t / 90.0 + phase) + 0.2 * noise;
+
+	* temperature_raw = (uint16_t)((temperature + 45.0) * 65536.0 / 175.0);
+	* humidity_raw = (uint16_t)(humidity * 65536.0 / 100.0);
+}
+
+static int SimTemperatureFirst(uint16_t command)
+{
+	return command == 0x7866 || command == 0x7CA2 || command == 0x609C || command == 0x6458;
+}
+
+static int SimClockStretching(uint16_t command)
+{
+	return command == 0x7CA2 || command == 0x5C24 || command == 0x6458 || command == 0x44DE;
+}
+
+static int SimLowPower(uint16_t command)
+{
+	return command == 0x609C || command == 0x6458 || command == 0x401A || command == 0x44DE;
+}
+
+static void SimInjectFault(SIM_DEVICE * device)
+{
+	// draws the fault of the next transaction, hangs persist until cleared
+	device->fault = -1;
+	if (!sim_fault_rate || (unsigned long)(rand_r(&device->random_state) % 1000) >= sim_fault_rate) return;
+	device->fault = rand_r(&device->random_state) % SIM_NUMBER_OF_FAULTS;
+	if (device->fault == SIM_FAULT_SENSOR_HANG || device->fault == SIM_FAULT_BUS_HANG) device->hang = device->fault;
+}
+
+static void SimInjectStall(SIM_DEVICE * device)
+{
+	if (device->stall >= 0 || !sim_stall_rate || (unsigned long)(rand_r(&device->random_state) % 1000) >= sim_stall_rate) return;
+	device->stall = rand_r(&device->random_state) % SIM_NUMBER_OF_STALLS;
+}
+
+static void SimSht3xWrite(SIM_DEVICE * device, uint16_t command)
+{
+	// while measuring periodically only fetch, break and soft reset are acknowledged
+	unsigned int rate;
+
+	for (rate = 0; rate < sizeof(sim_sht3x_periodic_commands) / sizeof(sim_sht3x_periodic_commands[0]); rate++)
+		if (command == sim_sht3x_periodic_commands[rate]) break;
+	if (device->sht3x_interval > 0 && command != 0xE000 && command != 0x3093 && command != 0x30A2)
+	{
+		device->reply.Bytes[0] = 0x80;
+		return;
+	}
+
+	device->sht3x_command = command;
+	device->sht3x_measuring = 0;
+	switch (command)
+	{
+		case 0x2400: case 0x2416: case 0x2C06: case 0x2C10:
+			device->sht3x_measuring = 1;
+			clock_gettime(CLOCK_MONOTONIC, &device->sht3x_conversion_start);
+			break;
+		case 0x3093: case 0x30A2:
+			device->sht3x_interval = 0;
+			device->sht3x_command = 0;
+			break;
+		case 0xF32D: case 0xE000:
+			break;
+		default:
+			if (rate == sizeof(sim_sht3x_periodic_commands) / sizeof(sim_sht3x_periodic_commands[0]))
+			{
+				device->sht3x_command = 0;
+				device->reply.Bytes[0] = 0x80;
+				return;
+			}
+			device->sht3x_interval = sim_sht3x_periodic_intervals[rate];
+			device->sht3x_fetched = 0;
+			device->sht3x_command = 0;
+			clock_gettime(CLOCK_MONOTONIC, &device->sht3x_periodic_start);
+			break;
+	}
+	device->reply.Bytes[0] = 3;
+}
+
+static void SimSht3xRead(SIM_DEVICE * device)
+{
+	// T always comes first, a read consumes the command
+	uint16_t command = device->sht3x_command;
+	uint16_t temperature_raw, humidity_raw;
+	unsigned long measurements;
+	double remaining_us;
+
+	device->sht3x_command = 0;
+	if (command == 0xF32D)
+	{
+		SimPutWord(&device->reply.Bytes[1], 0x0000);
+		return;
+	}
+	if (command == 0xE000)
+	{
+		measurements = device->sht3x_interval > 0 ? (unsigned long)(SimElapsed(device->sht3x_periodic_start) / device->sht3x_interval) : 0;
+		if (measurements <= device->sht3x_fetched)
+		{
+			device->reply.Bytes[0] |= 0x80; // no new measurement, the read header is not acknowledged
+			return;
+		}
+		device->sht3x_fetched = measurements;
+	}
+	else if (device->sht3x_measuring)
+	{
+		remaining_us = ((command == 0x2416 || command == 0x2C10) ? SIM_SHT3X_CONVERSION_TIME_LOW_US : SIM_SHT3X_CONVERSION_TIME_US) - SimElapsed(device->sht3x_conversion_start) * 1000000;
+		if (remaining_us > 0)
+		{
+			if (command == 0x2400 || command == 0x2416)
+			{
+				device->sht3x_command = command; // polling: conversion still running
+				device->reply.Bytes[0] |= 0x80;
+				return;
+			}
+			usleep((useconds_t)remaining_us);
+		}
+		device->sht3x_measuring = 0;
+	}
+	else
+	{
+		device->reply.Bytes[0] |= 0x80;
+		return;
+	}
+
+	SimMeasure(device, &temperature_raw, &humidity_raw);
+	SimPutWord(&device->reply.Bytes[1], temperature_raw);
+	SimPutWord(&device->reply.Bytes[4], humidity_raw);
+	if (device->fault == SIM_FAULT_T_CRC) device->reply.Bytes[3] ^= 0x01;
+	if (device->fault == SIM_FAULT_RH_CRC) device->reply.Bytes[6] ^= 0x01;
+}
+
+static void SimI2cWrite(SIM_DEVICE * device, IOWKIT_SPECIAL_REPORT * report)
+{
+	uint8_t count = report->Bytes[0] & 0x07;
+	uint16_t command = (uint16_t)((report->Bytes[2] << 8) | report->Bytes[3]);
+	memset(&device->reply, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+	device->reply.ReportID = 0x02;
+
+	SimInjectFault(device);
+	if (device->hang == SIM_FAULT_SENSOR_HANG && command == 0x805D) device->hang = -1;
+
+	if (sim_sht3x && (report->Bytes[1] >> 1) == SIM_SHT3X_ADDRESS)
+	{
+		if (!device->i2c_enabled || count != 3 || device->fault == SIM_FAULT_NACK || device->hang == SIM_FAULT_BUS_HANG) device->reply.Bytes[0] = 0x80;
+		else SimSht3xWrite(device, command);
+		return;
+	}
+
+	if (!device->i2c_enabled || (report->Bytes[1] >> 1) != SIM_SENSOR_ADDRESS || count != 3 || device->fault == SIM_FAULT_NACK || device->hang >= 0)
+	{
+		device->reply.Bytes[0] = 0x80; // no acknowledge
+		return;
+	}
+
+	device->last_command = command;
+	device->measuring = 0;
+	switch (device->last_command)
+	{
+		case 0x7866: case 0x7CA2: case 0x58E0: case 0x5C24: // normal mode
+		case 0x609C: case 0x6458: case 0x401A: case 0x44DE: // low power mode
+			device->measuring = 1;
+			clock_gettime(CLOCK_MONOTONIC, &device->conversion_start);
+			break;
+		case 0xEFC8: case 0x805D:
+			break;
+		default:
+			device->reply.Bytes[0] = 0x80;
+			return;
+	}
+	device->reply.Bytes[0] = count;
+}
+
+static void SimI2cRead(SIM_DEVICE * device, IOWKIT_SPECIAL_REPORT * report)
+{
+	uint8_t count = report->Bytes[0];
+	uint16_t temperature_raw, humidity_raw;
+	double remaining_us;
+	int clock_stretching;
+
+	memset(&device->reply, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+	device->reply.ReportID = 0x03;
+	device->reply.Bytes[0] = count;
+
+	if (sim_sht3x && (report->Bytes[1] >> 1) == SIM_SHT3X_ADDRESS)
+	{
+		if (!device->i2c_enabled || count > 6 || device->hang == SIM_FAULT_BUS_HANG) device->reply.Bytes[0] |= 0x80;
+		else SimSht3xRead(device);
+		return;
+	}
+
+	if (!device->i2c_enabled || (report->Bytes[1] >> 1) != SIM_SENSOR_ADDRESS || count > 6 || device->hang >= 0)
+	{
+		device->reply.Bytes[0] |= 0x80;
+		return;
+	}
+
+	if (device->last_command == 0xEFC8)
+	{
+		SimPutWord(&device->reply.Bytes[1], SIM_SENSOR_ID);
+		return;
+	}
+
+	if (!device->measuring)
+	{
+		device->reply.Bytes[0] |= 0x80; // nothing to read, sensor does not acknowledge the header
+		return;
+	}
+
+	remaining_us = (SimLowPower(device->last_command) ? SIM_CONVERSION_TIME_LOW_POWER_US : SIM_CONVERSION_TIME_US) - SimElapsed(device->conversion_start) * 1000000;
+	clock_stretching = SimClockStretching(device->last_command);
+	if (remaining_us > 0)
+	{
+		if (!clock_stretching)
+		{
+			device->reply.Bytes[0] |= 0x80; // polling: conversion still running
+			return;
+		}
+		usleep((useconds_t)remaining_us); // sensor holds SCL low until the conversion ends
+	}
+
+	device->measuring = 0;
+	SimMeasure(device, &temperature_raw, &humidity_raw);
+	if (SimTemperatureFirst(device->last_command))
+	{
+		SimPutWord(&device->reply.Bytes[1], temperature_raw);
+		SimPutWord(&device->reply.Bytes[4], humidity_raw);
+	}
+	else
+	{
+		SimPutWord(&device->reply.Bytes[1], humidity_raw);
+		SimPutWord(&device->reply.Bytes[4], temperature_raw);
+	}
+	if (device->fault == SIM_FAULT_T_CRC) device->reply.Bytes[SimTemperatureFirst(device->last_command) ? 3 : 6] ^= 0x01;
+	if (device->fault == SIM_FAULT_RH_CRC) device->reply.Bytes[SimTemperatureFirst(device->last_command) ? 6 : 3] ^= 0x01;
+}
+
+static unsigned long SimListValue(const char * list, unsigned long index)
+{
+	// index-th number of a comma separated list, the list repeats, 0 without a list
+	const char * position = list;
+	unsigned long count = 1;
+
+	if (!list) return 0;
+	for (; * position; position++) if (* position == ',') count++;
+	for (position = list, index %= count; index; index--) position = strchr(position, ',') + 1;
+	return strtoul(position, NULL, 10);
+}
+
+static void SimTakeHubSlot(SIM_HUB * hub)
+{
+	if (!sim_hub_slots) return;
+	pthread_mutex_lock(&hub->mutex);
+	while (hub->busy >= sim_hub_slots) pthread_cond_wait(&hub->free, &hub->mutex);
+	hub->busy++;
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+static void SimGiveHubSlot(SIM_HUB * hub)
+{
+	if (!sim_hub_slots) return;
+	pthread_mutex_lock(&hub->mutex);
+	hub->busy--;
+	pthread_cond_signal(&hub->free);
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+static void SimWriteAttribute(const char * directory, const char * attribute, const char * format, unsigned long value)
+{
+	char path[256];
+	FILE * attribute_file;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, attribute);
+	if ((attribute_file = fopen(path, "w")) == NULL) return;
+	fprintf(attribute_file, format, value);
+	fputc('\n', attribute_file);
+	fclose(attribute_file);
+}
+
+static void SimWriteSysfs(const char * root, unsigned long controllers, unsigned long hub_size)
+{
+	// a directory with the attributes read by the topology discovery for every root hub, external hub and stick
+	char directory[256];
+	unsigned long i;
+
+	mkdir(root, 0755);
+	for (i = 0; i < controllers; i++)
+	{
+		snprintf(directory, sizeof(directory), "%s/usb%lu", root, i + 1);
+		mkdir(directory, 0755);
+		SimWriteAttribute(directory, "idVendor", "%04lx", SIM_ROOT_HUB_VENDOR_ID);
+		SimWriteAttribute(directory, "busnum", "%lu", i + 1);
+	}
+	for (i = 0; hub_size && i < sim_number_of_hubs; i++)
+	{
+		snprintf(directory, sizeof(directory), "%s/%lu-%lu", root, i % controllers + 1, i / controllers + 1);
+		mkdir(directory, 0755);
+		SimWriteAttribute(directory, "idVendor", "%04lx", SIM_HUB_VENDOR_ID);
+		SimWriteAttribute(directory, "busnum", "%lu", i % controllers + 1);
+	}
+	for (i = 0; i < sim_number_of_devices; i++)
+	{
+		snprintf(directory, sizeof(directory), "%s/%s", root, sim_devices[i].port_path);
+		mkdir(directory, 0755);
+		SimWriteAttribute(directory, "idVendor", "%04lx", IOWKIT_VENDOR_ID);
+		SimWriteAttribute(directory, "idProduct", "%04lx", sim_product_id);
+		SimWriteAttribute(directory, "serial", "%08lX", sim_devices[i].serial_number);
+		SimWriteAttribute(directory, "busnum", "%lu", strtoul(sim_devices[i].port_path, NULL, 10));
+		snprintf(directory, sizeof(directory), "%s/%s:1.0", root, sim_devices[i].port_path); // interface, not a device
+		mkdir(directory, 0755);
+	}
+}
+
+IOWKIT_HANDLE IOWKIT_API IowKitOpenDevice(void)
+{
+	unsigned long i, hub;
+	unsigned long controllers, hub_size;
+	char * value;
+	char * latencies;
+
+	if (sim_devices) return &sim_devices[0];
+
+	clock_gettime(CLOCK_MONOTONIC, &sim_start);
+	latencies = getenv("IOWKIT_SIM_LATENCY_US");
+	value = getenv("IOWKIT_SIM_FAULT_RATE");
+	sim_fault_rate = value ? strtoul(value, NULL, 10) : 0;
+	value = getenv("IOWKIT_SIM_STALL_RATE");
+	sim_stall_rate = value ? strtoul(value, NULL, 10) : 0;
+	value = getenv("IOWKIT_SIM_PRODUCT_ID");
+	sim_product_id = value ? strtoul(value, NULL, 0) : IOWKIT_PRODUCT_ID_IOW24;
+	sim_sht3x = getenv("IOWKIT_SIM_SHT3X") != NULL;
+	value = getenv("IOWKIT_SIM_CONTROLLERS");
+	controllers = value ? strtoul(value, NULL, 10) : 1;
+	if (!controllers) controllers = 1;
+	value = getenv("IOWKIT_SIM_HUB_SIZE");
+	hub_size = value ? strtoul(value, NULL, 10) : 0;
+	value = getenv("IOWKIT_SIM_HUB_SLOTS");
+	sim_hub_slots = value ? strtoul(value, NULL, 10) : 0;
+	value = getenv("IOWKIT_SIM_DEVICES");
+	sim_number_of_devices = value ? strtoul(value, NULL, 10) : sizeof(sim_default_serial_numbers) / sizeof(sim_default_serial_numbers[0]);
+	if (!sim_number_of_devices) return NULL;
+
+	sim_number_of_hubs = hub_size ? (sim_number_of_devices + hub_size - 1) / hub_size : controllers;
+	sim_hubs = calloc(sim_number_of_hubs, sizeof(SIM_HUB));
+	for (i = 0; i < sim_number_of_hubs; i++)
+	{
+		pthread_mutex_init(&sim_hubs[i].mutex, NULL);
+		pthread_cond_init(&sim_hubs[i].free, NULL);
+	}
+
+	sim_devices = calloc(sim_number_of_devices, sizeof(SIM_DEVICE));
+	for (i = 0; i < sim_number_of_devices; i++)
+	{
+		// hub h is port h / controllers + 1 of the root hub of controller h % controllers + 1
+		hub = hub_size ? i / hub_size : i % controllers;
+		if (hub_size) snprintf(sim_devices[i].port_path, SIM_PORT_PATH_LENGTH, "%lu-%lu.%lu", hub % controllers + 1, hub / controllers + 1, i % hub_size + 1);
+		else snprintf(sim_devices[i].port_path, SIM_PORT_PATH_LENGTH, "%lu-%lu", hub + 1, i / controllers + 1);
+		sim_devices[i].hub = &sim_hubs[hub];
+		sim_devices[i].serial_number = value ? SIM_SERIAL_NUMBER_BASE + i : sim_default_serial_numbers[i];
+		sim_devices[i].random_state = (unsigned int)(i + 1);
+		sim_devices[i].timeout_ms = SIM_DEFAULT_TIMEOUT_MS;
+		sim_devices[i].latency_us = SimListValue(latencies, i);
+		sim_devices[i].fault = -1;
+		sim_devices[i].hang = -1;
+		sim_devices[i].stall = -1;
+		pthread_mutex_init(&sim_devices[i].mutex, NULL);
+		pthread_cond_init(&sim_devices[i].cancel, NULL);
+	}
+	value = getenv("IOWKIT_SIM_SYSFS");
+	if (value) SimWriteSysfs(value, controllers, hub_size);
+	return &sim_devices[0];
+}
+
+void IOWKIT_API IowKitCloseDevice(IOWKIT_HANDLE devHandle)
+{
+	// like the original library, closes all opened devices
+	unsigned long i;
+	if (!sim_devices) return;
+	for (i = 0; i < sim_number_of_devices; i++)
+	{
+		pthread_mutex_destroy(&sim_devices[i].mutex);
+		pthread_cond_destroy(&sim_devices[i].cancel);
+	}
+	free(sim_devices);
+	sim_devices = NULL;
+	sim_number_of_devices = 0;
+	for (i = 0; i < sim_number_of_hubs; i++)
+	{
+		pthread_mutex_destroy(&sim_hubs[i].mutex);
+		pthread_cond_destroy(&sim_hubs[i].free);
+	}
+	free(sim_hubs);
+	sim_hubs = NULL;
+	sim_number_of_hubs = 0;
+}
+
+ULONG IOWKIT_API IowKitWrite(IOWKIT_HANDLE devHandle, ULONG numPipe, PCHAR buffer, ULONG length)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	IOWKIT_SPECIAL_REPORT report;
+	unsigned long bus_bytes = 0;
+
+	if (!device || numPipe != IOW_PIPE_SPECIAL_MODE || length != IOWKIT_SPECIAL_REPORT_SIZE) return 0;
+	memcpy(&report, buffer, IOWKIT_SPECIAL_REPORT_SIZE);
+
+	pthread_mutex_lock(&device->mutex);
+	switch (report.ReportID)
+	{
+		case 0x01:
+			device->i2c_enabled = report.Bytes[0] & 0x01;
+			if (!device->i2c_enabled) device->hang = -1;
+			if (!device->i2c_enabled && device->stall == SIM_STALL_STICK) device->stall = -1;
+			if (sim_product_id == IOWKIT_PRODUCT_ID_IOW56 || sim_product_id == IOWKIT_PRODUCT_ID_IOW56_ALPHA)
+				device->i2c_clock_khz = sim_iow56_clocks_khz[report.Bytes[2] & 0x03];
+			break;
+		case 0x02:
+			SimInjectStall(device);
+			SimI2cWrite(device, &report);
+			device->reply_pending = (device->fault != SIM_FAULT_LOST_REPLY);
+			bus_bytes = report.Bytes[0] & 0x07; // address byte included
+			break;
+		case 0x03:
+			SimI2cRead(device, &report);
+			device->reply_pending = 1;
+			bus_bytes = report.Bytes[0] + 1;
+			break;
+	}
+	pthread_mutex_unlock(&device->mutex);
+	if (device->i2c_clock_khz && bus_bytes) usleep(bus_bytes * SIM_BITS_PER_BYTE * 1000 / device->i2c_clock_khz);
+	return length;
+}
+
+ULONG IOWKIT_API IowKitRead(IOWKIT_HANDLE devHandle, ULONG numPipe, PCHAR buffer, ULONG length)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	ULONG result = 0;
+
+	if (!device || numPipe != IOW_PIPE_SPECIAL_MODE || length != IOWKIT_SPECIAL_REPORT_SIZE) return 0;
+	if (device->latency_us)
+	{
+		SimTakeHubSlot(device->hub);
+		usleep(device->latency_us);
+		SimGiveHubSlot(device->hub);
+	}
+
+	pthread_mutex_lock(&device->mutex);
+	if (device->stall >= 0)
+	{
+		// the transfer hangs past any timeout, only a cancel returns it
+		device->cancelled = 0;
+		while (!device->cancelled) pthread_cond_wait(&device->cancel, &device->mutex);
+		if (device->stall == SIM_STALL_TRANSIENT) device->stall = -1;
+		device->reply_pending = 0;
+		pthread_mutex_unlock(&device->mutex);
+		return 0;
+	}
+	if (device->reply_pending)
+	{
+		memcpy(buffer, &device->reply, IOWKIT_SPECIAL_REPORT_SIZE);
+		device->reply_pending = 0;
+		result = length;
+	}
+	pthread_mutex_unlock(&device->mutex);
+
+	if (!result) usleep(device->timeout_ms * 1000); // nothing will ever arrive, wait for the timeout
+	return result;
+}
+
+ULONG IOWKIT_API IowKitReadNonBlocking(IOWKIT_HANDLE devHandle, ULONG numPipe, PCHAR buffer, ULONG length)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	ULONG result = 0;
+
+	if (!device || numPipe != IOW_PIPE_SPECIAL_MODE || length != IOWKIT_SPECIAL_REPORT_SIZE) return 0;
+	pthread_mutex_lock(&device->mutex);
+	if (device->reply_pending)
+	{
+		memcpy(buffer, &device->reply, IOWKIT_SPECIAL_REPORT_SIZE);
+		device->reply_pending = 0;
+		result = length;
+	}
+	pthread_mutex_unlock(&device->mutex);
+	return result;
+}
+
+BOOL IOWKIT_API IowKitReadImmediate(IOWKIT_HANDLE devHandle, PDWORD value)
+{
+	return FALSE;
+}
+
+ULONG IOWKIT_API IowKitGetNumDevs(void)
+{
+	return sim_number_of_devices;
+}
+
+IOWKIT_HANDLE IOWKIT_API IowKitGetDeviceHandle(ULONG numDevice)
+{
+	if (numDevice < 1 || numDevice > sim_number_of_devices) return NULL;
+	return &sim_devices[numDevice - 1];
+}
+
+BOOL IOWKIT_API IowKitSetLegacyOpenMode(ULONG legacyOpenMode)
+{
+	return TRUE;
+}
+
+ULONG IOWKIT_API IowKitGetProductId(IOWKIT_HANDLE devHandle)
+{
+	return devHandle ? sim_product_id : 0;
+}
+
+ULONG IOWKIT_API IowKitGetRevision(IOWKIT_HANDLE devHandle)
+{
+	return devHandle ? IOW_NON_LEGACY_REVISION : 0;
+}
+
+HANDLE IOWKIT_API IowKitGetThreadHandle(IOWKIT_HANDLE devHandle)
+{
+	return 0;
+}
+
+BOOL IOWKIT_API IowKitGetSerialNumber(IOWKIT_HANDLE devHandle, PWCHAR serialNumber)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	char serial_number_string[9];
+	int j;
+
+	if (!device) return FALSE;
+	snprintf(serial_number_string, sizeof(serial_number_string), "%08X", device->serial_number);
+	for (j = 0; j < 9; j++) serialNumber[j] = serial_number_string[j];
+	return TRUE;
+}
+
+BOOL IOWKIT_API IowKitSetTimeout(IOWKIT_HANDLE devHandle, ULONG timeout)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	if (!device) return FALSE;
+	device->timeout_ms = timeout;
+	return TRUE;
+}
+
+BOOL IOWKIT_API IowKitSetWriteTimeout(IOWKIT_HANDLE devHandle, ULONG timeout)
+{
+	return devHandle ? TRUE : FALSE;
+}
+
+BOOL IOWKIT_API IowKitCancelIo(IOWKIT_HANDLE devHandle, ULONG numPipe)
+{
+	SIM_DEVICE * device = (SIM_DEVICE *) devHandle;
+	if (!device) return FALSE;
+	pthread_mutex_lock(&device->mutex);
+	device->cancelled = 1;
+	pthread_cond_broadcast(&device->cancel);
+	pthread_mutex_unlock(&device->mutex);
+	return TRUE;
+}
+
+PCSTR IOWKIT_API IowKitVersion(void)
+{
+	return "IO-Warrior Kit simulator";
+}
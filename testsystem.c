@@ -1,6 +1,7 @@
 //
 // prepared by: Tomasz Gadek CERN 2016 <tomasz.gadek@cern.ch>
 // to compile: use prepared Makefile command 'make' or 'gcc testsystem.c -o testsystem -l iowkit -lm -lrt'
+// fixed benches: 'make compile-static' bakes the configuration into the binary, see STATIC_CONFIGURATION
 // 
 // Test conditions:
 // Scientific Linux CERN 6, kernel 2.6.32-573.12.1.el6.x86_64
@@ -9,7 +10,13 @@
 // iowarrior-2.6 with modifications for RedHat by Tomasz Gadek
 //
 
+#define _GNU_SOURCE // sched_setaffinity() and the CPU_SET() macros
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,15 +24,50 @@
 #include <unistd.h>
 #include <math.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "iowkit.h"
 
+// Static tracepoints (USDT) for perf, bpftrace or SystemTap, for example:
+//   bpftrace -e 'usdt:./testsystem:testsystem:read_i2c_return { @status[arg0, arg1] = count(); }'
+// Probes: write_i2c_entry(serial, command), write_i2c_return(serial, command, status), read_i2c_entry(serial, count),
+// read_i2c_return(serial, status), sweep_start(sweep, number_of_sensors), sweep_done(sweep, status),
+// record_write_entry(number_of_sensors), record_line(serial, length), record_write_return(records, flush_status),
+// plot_update_entry(number_of_sensors), plot_update_return(flush_status), sensor_recovery(serial, action, status),
+// configuration_reload(kept, added, removed), usb_stall(serial, stall_ms), sticks_reopen(sticks, bound_sensors).
+// Every probe is a single nop until a tracer attaches. Without <sys/sdt.h> (Makefile defines HAVE_SYS_SDT_H when it
+// is installed) the probes compile to nothing, arguments are only evaluated.
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE1(name, arg1) DTRACE_PROBE1(testsystem, name, arg1)
+#define PROBE2(name, arg1, arg2) DTRACE_PROBE2(testsystem, name, arg1, arg2)
+#define PROBE3(name, arg1, arg2, arg3) DTRACE_PROBE3(testsystem, name, arg1, arg2, arg3)
+#else
+#define PROBE1(name, arg1) ((void)(arg1))
+#define PROBE2(name, arg1, arg2) ((void)(arg1), (void)(arg2))
+#define PROBE3(name, arg1, arg2, arg3) ((void)(arg1), (void)(arg2), (void)(arg3))
+#endif
+
 // I2C Transmission parameters taken from SHTW1 datasheet
-#define I2C_WRITE_COMMAND 0xE0 //write command, sensor I2C address followed by a write bit 
-#define I2C_READ_COMMAND 0xE1 //read command, sensor I2C address followeb by a read bit
+#define I2C_DEFAULT_ADDRESS 0x70 // SHTC1/SHTW1 7bit I2C address, shifted left and followed by a read or write bit on the bus
+#define I2C_MIN_ADDRESS 0x08 // range of 7bit addresses not reserved by the I2C specification
+#define I2C_MAX_ADDRESS 0x77
 #define I2C_RETRY_LIMIT 5 //number of retries to communicate with I2C device
+#define I2C_MAX_CLOCK_KHZ 3400 // I2C high speed mode limit, the clocks a stick supports are in i2c_clock_settings
+#define I2C_CLOCK_FIXED 0xFF // stick without a clock setting in the I2C enable report, it always runs at the listed clock
 #define CRC_POLYNOMIAL 0x131 //CRC polynomial
 
 // Sensor Commands taken from SHTW1 datasheet
@@ -35,6 +77,34 @@
 #define	MEASURE_T_RH_CLKSTR 0x7CA2 // issue measuring, read T measurement first, clock stretching enabled
 #define	MEASURE_RH_T_POLLING 0x58E0 // issue measuring, read RH measurement first, clock stretching disabled
 #define MEASURE_RH_T_CLKSTR 0x5C24 // issue measuring, read RH measurement first, clock stretching enabled
+#define MEASURE_T_RH_POLLING_LOW_POWER 0x609C // issue measuring in low power mode, read T measurement first, clock stretching disabled
+#define MEASURE_RH_T_POLLING_LOW_POWER 0x401A // issue measuring in low power mode, read RH measurement first, clock stretching disabled
+#define MEASURE_T_RH_CLKSTR_LOW_POWER 0x6458 // issue measuring in low power mode, read T measurement first, clock stretching enabled
+#define MEASURE_RH_T_CLKSTR_LOW_POWER 0x44DE // issue measuring in low power mode, read RH measurement first, clock stretching enabled
+#define CONVERSION_TIME_US 14400 // maximum measurement duration in normal mode, SHTC1 datasheet
+#define CONVERSION_TIME_LOW_POWER_US 940 // maximum measurement duration in low power mode, SHTC1 datasheet
+#define SOFT_RESET_TIME_US 240 // maximum soft reset duration, SHTC1 datasheet
+#define SHTC1_PRODUCT_CODE 0x07 // bits 5 to 0 of the ID register, the same for SHTC1 and SHTW1
+
+// SHT3x commands and timing taken from SHT3x-DIS datasheet, the part has no ID register, it is detected by its status register
+#define SHT3X_ADDRESS 0x44 // SHT3x 7bit I2C address with ADDR pin low, 0x45 with ADDR pin high
+#define SHT3X_READ_STATUS 0xF32D // read status register, a 2 byte word with CRC
+#define SHT3X_SOFT_RESET 0x30A2
+#define SHT3X_BREAK 0x3093 // stops the periodic mode, the sensor accepts only fetch, break and soft reset while measuring periodically
+#define SHT3X_FETCH_DATA 0xE000 // reads the last periodic measurement, the read header is not acknowledged when there is none
+#define SHT3X_MEASURE_HIGH 0x2400 // single shot, high repeatability, clock stretching disabled
+#define SHT3X_MEASURE_LOW 0x2416 // single shot, low repeatability, clock stretching disabled
+#define SHT3X_MEASURE_HIGH_CLKSTR 0x2C06 // single shot, high repeatability, clock stretching enabled
+#define SHT3X_MEASURE_LOW_CLKSTR 0x2C10 // single shot, low repeatability, clock stretching enabled
+#define SHT3X_CONVERSION_TIME_US 15500 // maximum measurement duration with high repeatability
+#define SHT3X_CONVERSION_TIME_LOW_POWER_US 4500 // maximum measurement duration with low repeatability
+#define SHT3X_SOFT_RESET_TIME_US 1500 // maximum soft reset duration
+#define SHT3X_BREAK_TIME_US 1000 // the periodic measurement in progress is finished before the break is executed
+#define SHT3X_PERIODIC_RATES 5 // 0.5, 1, 2, 4 and 10 measurements per second
+#define I2C_TIMEOUT_MS 100 // IowKitRead timeout, a reply report not received in this time counts as a timeout
+#define I2C_REPORT_TIMEOUT 0xFF // Bytes[0] of a reply report that never arrived, the 0x80 error flag is set
+#define I2C_REPORT_STALL 0xFE // Bytes[0] of a reply report cancelled by the USB watchdog, the 0x80 error flag is set
+#define I2C_REPORT_NO_DATA 0xFD // Bytes[0] of a periodic mode fetch made before the next measurement, the 0x80 error flag is set
 
 // Dew point calculation coefficients, taken from SHT7x datasheet page 8.
 #define	T_PLUS  243.12 // T coefficient above 0[*C]
@@ -47,16 +117,116 @@
 #define UPDATE_ITERATION_NUMBER 4 // sets how often the gnuplots will be updated (1 = every iteration)
 #define NUMBER_OF_PLOT_POINTS 100 // sets length of on-line plots, it changes X axis range on plots
 				  // time in s on X axis = MEASUREMENT_DELAY_MS*NUMBER_OF_PLOT_POINTS+loop execution time
+#define PLOT_TITLE_LENGTH 64 // of a line of the on-line plots, longer sensor names are cut
+#define PLOT_WRITER_STACK_SIZE 262144 // of the plot writer thread, -l locks every stack
 
 // Parsing config file definitions
 #define SENSOR_BINDING_LIST_START "sensors:"
 #define BINDING_LIST_STOP "end."
-#define SEPARATION_CHAR '\t'
-#define MAX_SENSOR_NAME_LENGTH 30
+#define SEPARATION_CHARS " \t" // fields of a sensor line: <name> <stick_serial_number> [<key>=<value> ...]
+#define COMMENT_CHAR '#'
 #define MAX_SENSOR_INFO_LENGTH 40
-#define MIN_CONF_LINE_LENGTH 4	// minimum length of line for configuration info, <name><tabulator><stick_serial_number><new_line_symbol>
-				// therefore shorter lines than 4 characters should be ignored by parser
-#define MAX_CONF_LINE_LENGTH 40
+#define MAX_NUMBER_OF_SENSORS 1024 // size of the sensors table, the io-warrior library itself opens at most IOWKIT_MAX_DEVICES sticks
+#define SENSOR_INDEX_SIZE 2048 // slots of the stick serial number hash index, a power of two at least twice MAX_NUMBER_OF_SENSORS
+#define MAX_SAMPLE_PERIOD_MS 3600000
+#define MAX_CALIBRATION_OFFSET 50.0 // limit of the temperature [*C] and humidity [%] offsets
+#define NAME_POOL_CHUNK_SIZE 16384 // sensor names are stored one after another in chunks of this size, longer names get their own chunk
+#define VIRTUAL_STICK "virtual" // second field of a virtual sensor line instead of the stick serial number
+#define VIRTUAL_PROGRAM_SIZE 256 // bytes of the bytecode of one virtual channel expression
+#define VIRTUAL_STACK_DEPTH 16 // operands of an expression waiting for an operator
+#define VIRTUAL_UNDEFINED 1000.0 // value of a channel that is not read, a virtual channel using it is not defined either
+#define HISTORY_RAW_SAMPLES 1200 // in-process history of a sensor: raw samples, 5 minutes at the default sweep period
+#define HISTORY_MINUTE_BUCKETS 360 // then 1 minute aggregates for 6 hours
+#define HISTORY_QUARTER_BUCKETS 672 // and 15 minute aggregates for 7 days
+#define HISTORY_TIERS 2 // tiers of aggregates
+#define HISTORY_CHANNELS 3 // T, RH and dew point, in the order of the record line
+
+// Default command line options
+#define CONFIGURATION_FILE "configuration"
+#define RECORDS_DIRECTORY "records"
+#define PLOT_COMMAND "gnuplot" // every on-line plot is a separate process reading commands from a pipe
+#define MAX_FILE_PATH_LENGTH 256
+#define MAX_RECORD_LINE_LENGTH 128
+#define SHUTDOWN_DEADLINE_MS 5000 // records, plots and sticks are closed within this time after a stop request
+
+// Record store parameters, result files are text split into blocks sealed by a '#' trailer line (a gnuplot comment)
+// one line per sensor and sweep, the sensor name is the second column (the single sensor records had none: time temperature humidity dew_point)
+#define RECORD_HEADER "time sensor temperature humidity dew_point\n"
+#define RECORD_LINE_FORMAT "%0.3f %s %0.2f %0.2f %0.2f\n"
+#define RECORD_BLOCK_TRAILER "#B %u %u %08X\n" // sequence number, bytes of records in the block, their CRC32C
+#define RECORD_TRAILER_MAX_LENGTH 34
+#define RECORD_BLOCK_MAX_BYTES 65536 // a block is sealed when it reaches this size, a torn tail is never longer
+#define RECORD_SYNC_PERIOD_MS 1000 // the open block is sealed and synced at least this often, a power cut loses at most its records
+#define RECORDS_OPEN_MARKER ".recording" // in the records directory, names the result file being written until a clean shutdown
+
+// Microbenchmark parameters
+#define MICROBENCH_BATCH_SIZE 1024 // distinct inputs processed per batch run, like a sweep of MAX_NUMBER_OF_SENSORS sensors
+#define MICROBENCH_WARMUP_RUNS 50 // runs executed before timing to warm up caches and branch predictors
+#define MICROBENCH_RUNS 1000 // timed runs of every kernel
+#define MICROBENCH_OUTLIER_MADS 5 // runs further from the median than this many median absolute deviations are dropped
+#define MICROBENCH_REGRESSION_THRESHOLD 20 // percent of slowdown against the baseline reported as a regression
+#define MICROBENCH_REGRESSION_MIN_NS 10 // smaller slowdowns are within the clock resolution and never reported
+
+// Sample timestamp and jitter analysis parameters
+#define TIME_ANCHOR_PERIOD_S 60 // CLOCK_REALTIME anchor refresh period, NTP slewing between anchors does not move the timestamps
+#define TIME_ANCHOR_TRIALS 5 // realtime reads bracketed by monotonic reads, the tightest bracket becomes the anchor
+#define JITTER_BIN_US 100 // width of a bin of the sample interval jitter histogram
+#define JITTER_BINS 500 // the last bin collects all larger jitter values
+
+// Real-time scheduling parameters
+#define WAKEUP_PROBE_SLEEPS 200 // sleeps timed before and after switching the acquisition thread to SCHED_FIFO
+#define WAKEUP_PROBE_SLEEP_US 1000
+
+// Sensor health monitoring parameters
+#define HEALTH_WINDOW 32 // number of the most recent transactions of a sensor kept in its sliding window counters
+#define HEALTH_MIN_TRANSACTIONS 4 // transactions in the window needed before a recovery action, less than I2C_RETRY_LIMIT
+#define HEALTH_RECOVERY_THRESHOLD 25 // percent of failed transactions in the window triggering a recovery action
+#define HEALTH_MAX_CONSECUTIVE_FAILURES 3 // failed transactions in a row triggering a recovery action, less than I2C_RETRY_LIMIT
+
+// USB watchdog parameters
+#define USB_STALL_TIMEOUT_MS 1000 // a USB report transfer still in flight after this time is cancelled, above I2C_TIMEOUT_MS
+#define USB_WATCHDOG_PERIOD_MS 100 // the watchdog thread checks the transfers in flight this often
+#define USB_WATCHDOG_CANCELLED 1 // deadline of a transfer cancelled by the watchdog, 0 = no transfer in flight
+
+// Adaptive sampling parameters, for sensors with max_period in the configuration
+#define ADAPTIVE_T_RATE 0.05 // *C/s, a faster temperature change switches the sensor to its fastest period
+#define ADAPTIVE_RH_RATE 0.5 // %/s
+#define ADAPTIVE_T_NOISE 0.1 // *C, smaller changes between two samples are sensor noise and never count as a rate of change
+#define ADAPTIVE_RH_NOISE 0.5 // %
+#define ADAPTIVE_T_DEVIATION 0.2 // *C, standard deviation of the recent readings switching the sensor to its fastest period
+#define ADAPTIVE_RH_DEVIATION 1.0 // %
+#define ADAPTIVE_WEIGHT 0.25 // weight of a new reading in the exponentially weighted mean and variance
+#define ADAPTIVE_STABLE_SAMPLES 4 // stable samples in a row before the period is doubled
+#define ADAPTIVE_MIN_STEP_MS 500 // first slower period of a sensor sampled every sweep
+
+// Trace event timeline parameters
+#define TRACE_BUFFER_SIZE 65536 // events kept per thread, the oldest events are overwritten
+#define TRACE_DUMP_MARGIN 64 // oldest events of a wrapped buffer skipped by a dump, the owner thread may be overwriting them
+
+// Daemon mode parameters
+#define WATCHDOG_HEARTBEAT_DIVIDER 2 // heartbeats are sent this many times per WatchdogSec= of the systemd service
+#define SHUTDOWN_POLL_US 1000 // plot processes are checked this often while waiting for them to quit
+
+// Control socket parameters
+#define CONTROL_MAX_CLIENTS 8 // connections served at once, further connections are refused
+#define CONTROL_LINE_LENGTH 256 // longest command line including the newline
+#define CONTROL_DEFAULT_SAMPLES 10 // samples returned by "last" without a count
+#define CONTROL_BUSY_REPLY "ERROR: too many control connections\n"
+#define CONTROL_DENIED_REPLY "ERROR: only the user of the testsystem and root may send commands\n"
+
+// Sweep scheduling parameters
+#define STICK_PROBE_ROUNDS 5 // identify transactions timed per USB stick at startup, the median round trip orders the sweep
+
+// Sweep worker parameters
+#define USB_SYSFS_DEVICES "/sys/bus/usb/devices" // a directory per USB device named by its bus and port path, e.g. 1-1.4.2
+#define USB_PORT_PATH_LENGTH 32 // "<bus>-<port>.<port>..." of a device 7 tiers deep
+#define HUB_MAX_WORKERS 2 // default sweep workers per hub of the topology layout, more threads only queue for the same hub
+#define SWEEP_WORKER_STACK_SIZE 262144 // of a sweep worker thread, -l locks every stack, the default of 8 MB would be locked for each worker
+#define MAX_SWEEP_WORKERS 64 // the sticks of further workers are dealt to the first ones
+
+// Sweep phase timing parameters
+#define PHASE_STATS_WINDOW 40 // number of most recent sweeps aggregated in the phase timing breakdown
+#define PHASE_REPORT_ITERATION_NUMBER 40 // sets how often the phase timing breakdown is printed (in sweeps)
 
 enum USB_STICKS_SN
 {
@@ -66,6 +236,238 @@ enum USB_STICKS_SN
 	inner_right_sensor_sn = 6367
 };
 
+enum HEALTH_EVENT
+{
+	HEALTH_OK = 0,
+	HEALTH_NACK,		// measure command or result read not acknowledged
+	HEALTH_TIMEOUT,		// USB stick did not send the reply report
+	HEALTH_T_CRC,		// temperature checksum error, the whole sample is lost
+	HEALTH_RH_CRC,		// humidity checksum error
+	HEALTH_STALL,		// USB transfer hung and was cancelled by the USB watchdog
+	NUMBER_OF_HEALTH_EVENTS
+};
+
+static const char * health_event_names[NUMBER_OF_HEALTH_EVENTS] = {"ok", "nack", "timeout", "t_crc", "rh_crc", "stall"};
+static const uint8_t health_event_weights[NUMBER_OF_HEALTH_EVENTS] = {0, 2, 2, 2, 1, 2}; // 2 = sample lost, 1 = half of the sample lost
+
+enum RECOVERY_ACTION
+{
+	RECOVERY_SOFT_RESET = 0,
+	RECOVERY_BUS_REENABLE,	// I2C disabled and enabled again on the USB stick, followed by a soft reset
+	NUMBER_OF_RECOVERY_ACTIONS
+};
+
+static const char * recovery_action_names[NUMBER_OF_RECOVERY_ACTIONS] = {"soft reset", "bus re-enable"};
+
+typedef struct SENSOR_HEALTH
+{
+	uint8_t window[HEALTH_WINDOW]; // HEALTH_EVENT of the most recent transactions
+	uint8_t window_index;
+	uint8_t window_length;
+	uint8_t window_counters[NUMBER_OF_HEALTH_EVENTS];
+	uint8_t consecutive_failures;
+	uint32_t counters[NUMBER_OF_HEALTH_EVENTS]; // since the program start
+	uint32_t recoveries[NUMBER_OF_RECOVERY_ACTIONS];
+	uint32_t failed_recoveries; // the driver could not initialize the part after the action
+	uint8_t escalation; // first RECOVERY_ACTION of the next recovery, back to the soft reset after a full window without a recovery
+	double action_time; // total time spent in recovery actions, paid by the sweeps
+	double max_action_time;
+	double recovery_start; // start of the last action, 0 = the sensor delivered a valid sample since then
+	double recovered_time; // total time from recovery actions to the next valid sample
+	double max_recovered_time;
+	uint32_t recovered;
+} SENSOR_HEALTH;
+
+typedef struct HISTORY_SAMPLE
+{
+	double time; // sample_time of the sensor, CLOCK_MONOTONIC
+	float values[HISTORY_CHANNELS]; // 1000 = channel not defined
+} HISTORY_SAMPLE;
+
+typedef struct HISTORY_BUCKET
+{
+	double start; // CLOCK_MONOTONIC, a multiple of the bucket length
+	uint32_t counts[HISTORY_CHANNELS]; // defined values of every channel
+	float min[HISTORY_CHANNELS];
+	float max[HISTORY_CHANNELS];
+	float sum[HISTORY_CHANNELS];
+} HISTORY_BUCKET;
+
+typedef struct HISTORY_TIER
+{
+	uint32_t bucket_seconds;
+	uint32_t number_of_buckets;
+	uint32_t offset; // first bucket of the tier in SENSOR_HISTORY buckets
+} HISTORY_TIER;
+
+static const HISTORY_TIER history_tiers[HISTORY_TIERS] = {{60, HISTORY_MINUTE_BUCKETS, 0}, {900, HISTORY_QUARTER_BUCKETS, HISTORY_MINUTE_BUCKETS}};
+
+// rings of a fixed size, allocated at once with the first sample of the sensor, so the memory is bounded by the number of sensors
+typedef struct SENSOR_HISTORY
+{
+	uint32_t raw_current; // position of the newest raw sample
+	uint32_t raw_count;
+	uint32_t bucket_current[HISTORY_TIERS]; // bucket being filled, relative to the tier offset
+	uint32_t bucket_count[HISTORY_TIERS];
+	HISTORY_SAMPLE raw[HISTORY_RAW_SAMPLES];
+	HISTORY_BUCKET buckets[HISTORY_MINUTE_BUCKETS + HISTORY_QUARTER_BUCKETS];
+} SENSOR_HISTORY;
+
+typedef struct ADAPTIVE_SAMPLING
+{
+	uint32_t period_ms; // current period, kept between period_ms and max_period_ms of the sensor
+	uint8_t stable_samples; // samples in a row below all thresholds
+	uint8_t period_changed; // the next interval follows a new period and is not counted as jitter
+	double sample_time; // previous sample
+	float temperature;
+	float humidity;
+	float temperature_mean; // exponentially weighted
+	float temperature_variance;
+	float humidity_mean;
+	float humidity_variance;
+	uint32_t saved_samples; // sweeps skipped that the fastest period would have sampled
+	uint32_t speedups; // switches back to the fastest period
+} ADAPTIVE_SAMPLING;
+
+enum MEASUREMENT_MODE
+{
+	MODE_NORMAL = 0,
+	MODE_LOW_POWER,		// faster and less repeatable conversion
+	NUMBER_OF_MEASUREMENT_MODES
+};
+
+static const char * measurement_mode_names[NUMBER_OF_MEASUREMENT_MODES] = {"normal", "low_power"};
+static const uint32_t conversion_times_us[NUMBER_OF_MEASUREMENT_MODES] = {CONVERSION_TIME_US, CONVERSION_TIME_LOW_POWER_US};
+
+enum MEASUREMENT_CHANNELS
+{
+	CHANNELS_T_RH = 0,	// both words read, 6 bytes
+	CHANNEL_T,		// only the first word of a T first measurement read, 3 bytes
+	CHANNEL_RH,		// only the first word of a RH first measurement read, 3 bytes
+	NUMBER_OF_CHANNEL_SELECTIONS
+};
+
+static const char * channel_selection_names[NUMBER_OF_CHANNEL_SELECTIONS] = {"t_rh", "t", "rh"};
+static const uint8_t channel_read_counts[NUMBER_OF_CHANNEL_SELECTIONS] = {6, 3, 3};
+
+enum READOUT
+{
+	READOUT_POLLING = 0,	// the conversion time is waited out on the PC, then the result is read
+	READOUT_CLOCK_STRETCHING,	// the result is read at once, the sensor holds SCL low until the conversion ends
+	READOUT_PERIODIC,	// the sensor measures on its own, a sweep only fetches the last result, SHT3x only
+	NUMBER_OF_READOUTS
+};
+
+static const char * readout_names[NUMBER_OF_READOUTS] = {"polling", "clock_stretching", "periodic"};
+static const uint16_t measurement_commands[NUMBER_OF_MEASUREMENT_MODES][READOUT_PERIODIC][NUMBER_OF_CHANNEL_SELECTIONS] = // SHTC1, no periodic mode
+{
+	{
+		{MEASURE_T_RH_POLLING, MEASURE_T_RH_POLLING, MEASURE_RH_T_POLLING},
+		{MEASURE_T_RH_CLKSTR, MEASURE_T_RH_CLKSTR, MEASURE_RH_T_CLKSTR}
+	},
+	{
+		{MEASURE_T_RH_POLLING_LOW_POWER, MEASURE_T_RH_POLLING_LOW_POWER, MEASURE_RH_T_POLLING_LOW_POWER},
+		{MEASURE_T_RH_CLKSTR_LOW_POWER, MEASURE_T_RH_CLKSTR_LOW_POWER, MEASURE_RH_T_CLKSTR_LOW_POWER}
+	}
+};
+
+// SHT3x always sends T first, the low power mode is the low repeatability
+static const uint32_t sht3x_conversion_times_us[NUMBER_OF_MEASUREMENT_MODES] = {SHT3X_CONVERSION_TIME_US, SHT3X_CONVERSION_TIME_LOW_POWER_US};
+static const uint16_t sht3x_single_shot_commands[NUMBER_OF_MEASUREMENT_MODES][READOUT_PERIODIC] =
+{
+	{SHT3X_MEASURE_HIGH, SHT3X_MEASURE_HIGH_CLKSTR},
+	{SHT3X_MEASURE_LOW, SHT3X_MEASURE_LOW_CLKSTR}
+};
+static const uint32_t sht3x_periodic_intervals_ms[SHT3X_PERIODIC_RATES] = {2000, 1000, 500, 250, 100};
+static const uint16_t sht3x_periodic_commands[NUMBER_OF_MEASUREMENT_MODES][SHT3X_PERIODIC_RATES] =
+{
+	{0x2032, 0x2130, 0x2236, 0x2334, 0x2737},
+	{0x202F, 0x212D, 0x2229, 0x232A, 0x272A}
+};
+
+enum DECODE_ERROR
+{
+	DECODE_T_CRC = 0x01,
+	DECODE_RH_CRC = 0x02
+};
+
+enum SENSOR_SINK
+{
+	SINK_RECORDS = 0x01,	// result file
+	SINK_PLOT = 0x02,	// on-line plots and plot snapshots, they are fed from the in-memory history
+	SINK_CONSOLE = 0x04,
+	ALL_SINKS = 0x07
+};
+
+static const char * sink_names[] = {"records", "plot", "console"};
+
+enum DERIVED_CHANNEL
+{
+	DERIVED_DEW_POINT = 0x01
+};
+
+enum CONFIGURATION_KEY
+{
+	KEY_PERIOD = 0,		// period=<ms>
+	KEY_MODE,		// mode=normal|low_power
+	KEY_ADDRESS,		// address=<7bit I2C address>, decimal or 0x hexadecimal
+	KEY_T_OFFSET,		// t_offset=<*C>
+	KEY_RH_OFFSET,		// rh_offset=<%>
+	KEY_SINKS,		// sinks=<records,plot,console>|none
+	KEY_DERIVED,		// derived=dew_point|none
+	KEY_MAX_PERIOD,		// max_period=<ms>
+	KEY_CHANNELS,		// channels=t_rh|t|rh
+	KEY_READOUT,		// readout=polling|clock_stretching|periodic
+	KEY_I2C_CLOCK,		// i2c_clock=<kHz>, for the whole USB stick
+	KEY_T,			// t=<expression>, virtual sensors only
+	KEY_RH,			// rh=<expression>
+	KEY_DP,			// dp=<expression>
+	NUMBER_OF_CONFIGURATION_KEYS
+};
+
+static const char * configuration_keys[NUMBER_OF_CONFIGURATION_KEYS] = {"period", "mode", "address", "t_offset", "rh_offset", "sinks", "derived", "max_period", "channels", "readout",
+	"i2c_clock", "t", "rh", "dp"};
+
+enum VIRTUAL_CHANNEL
+{
+	VIRTUAL_T = 0,
+	VIRTUAL_RH,
+	VIRTUAL_DP,
+	NUMBER_OF_VIRTUAL_CHANNELS
+};
+
+static const char * virtual_channel_names[NUMBER_OF_VIRTUAL_CHANNELS] = {"t", "rh", "dp"};
+
+// expressions of virtual sensors are compiled to a postfix bytecode, one byte per operation followed by its operands
+enum VIRTUAL_OPCODE
+{
+	VIRTUAL_END = 0,
+	VIRTUAL_CONSTANT,	// followed by a 4 byte float
+	VIRTUAL_CHANNEL,	// followed by the 2 byte sensors table position, high byte first, and the VIRTUAL_CHANNEL
+	VIRTUAL_ADD,
+	VIRTUAL_SUBTRACT,
+	VIRTUAL_MULTIPLY,
+	VIRTUAL_DIVIDE,
+	VIRTUAL_NEGATE
+};
+
+typedef struct I2C_CLOCK_SETTING
+{
+	uint32_t product_id;
+	uint16_t clock_khz;
+	uint8_t code; // Bytes[2] of the I2C enable report, I2C_CLOCK_FIXED = not sent
+} I2C_CLOCK_SETTING;
+
+// I2C clocks of the IO-Warrior products, the first entry of a product is its default clock
+static const I2C_CLOCK_SETTING i2c_clock_settings[] =
+{
+	{IOWKIT_PRODUCT_ID_IOW40, 100, I2C_CLOCK_FIXED},
+	{IOWKIT_PRODUCT_ID_IOW24, 100, I2C_CLOCK_FIXED},
+	{IOWKIT_PRODUCT_ID_IOW24_SENSI, 100, I2C_CLOCK_FIXED},
+	{IOWKIT_PRODUCT_ID_IOW56, 100, 0}, {IOWKIT_PRODUCT_ID_IOW56, 400, 1}, {IOWKIT_PRODUCT_ID_IOW56, 50, 2}, {IOWKIT_PRODUCT_ID_IOW56, 1000, 3},
+	{IOWKIT_PRODUCT_ID_IOW56_ALPHA, 100, 0}, {IOWKIT_PRODUCT_ID_IOW56_ALPHA, 400, 1}, {IOWKIT_PRODUCT_ID_IOW56_ALPHA, 50, 2}, {IOWKIT_PRODUCT_ID_IOW56_ALPHA, 1000, 3}
+};
+
 typedef struct SHTW1_SENSOR
 {		
 	uint32_t stick_serial_number;
@@ -73,147 +475,997 @@ typedef struct SHTW1_SENSOR
 	float temperature;
 	float humidity;
 	float dew_point;
-	char name[MAX_SENSOR_NAME_LENGTH];
+	char * name;
 	char info[MAX_SENSOR_INFO_LENGTH];
+	uint32_t configuration_line; // line of the sensor in the configuration file
+	uint8_t i2c_address;
+	uint8_t measurement_mode;
+	uint8_t channels; // MEASUREMENT_CHANNELS, a channel not read stays at 1000
+	uint8_t readout; // READOUT
+	uint8_t driver; // index into sensor_drivers, set when the part answers one of the drivers
+	uint16_t i2c_clock_khz; // clock of the USB stick, the same for all its sensors, 0 = the stick default
+	uint32_t period_ms; // minimum time between samples, 0 = every sweep
+	uint32_t max_period_ms; // adaptive sampling: the period grows up to this while the readings are stable, 0 = fixed period
+	float temperature_offset; // calibration, added to the converted values
+	float humidity_offset;
+	uint8_t sinks; // SENSOR_SINK flags
+	uint8_t derived_channels; // DERIVED_CHANNEL flags
+	uint8_t fresh; // a sample not yet written to the result file
+	int32_t next_on_stick; // next sensor on the same USB stick, -1 = last one
+	uint16_t stick_rank; // position among the bound sensors of its stick in the sweep schedule
+	double usb_round_trip; // of one special mode report to its stick and the reply, median of the startup probe in seconds, 0 = not measured
+	SENSOR_HEALTH health;
+	SENSOR_HISTORY * history; // allocated by AllocateHistories when the sensor is bound, NULL for an unbound sensor
+	const uint8_t * programs[NUMBER_OF_VIRTUAL_CHANNELS]; // virtual sensor (stick serial number 0): bytecode of the t, rh and dp expressions, NULL = not defined
+	double sample_time; // CLOCK_MONOTONIC at the midpoint of the I2C transaction of the last valid sample, in seconds
+	double sample_interval; // time between the two last valid samples
+	uint32_t number_of_intervals;
+	double interval_mean; // running mean and sum of squared deviations of the intervals (Welford)
+	double interval_m2;
+	double interval_min;
+	double interval_max;
+	ADAPTIVE_SAMPLING adaptive;
 } SHTW1_SENSOR;
 
+typedef struct VIRTUAL_COMPILER
+{
+	SHTW1_SENSOR * table; // sensors above the virtual sensor, the only ones an expression may use
+	int32_t * name_index; // sensor name hash index into the table
+	char * position; // next character of the expression
+	uint8_t program[VIRTUAL_PROGRAM_SIZE];
+	size_t length;
+	uint8_t depth; // operands on the evaluation stack after the code emitted so far
+	const char * error;
+} VIRTUAL_COMPILER;
+
+// every Sensirion part the system can sample, the sweep only calls these, the cheapest access pattern of a part is
+// hidden behind them: a periodic mode SHT3x sends nothing in trigger and waits nothing, the fetch reads the last result
+typedef struct SENSOR_DRIVER
+{
+	const char * name;
+	uint8_t readouts; // bit per READOUT the part supports
+	int (* identify)(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address); // 0 = the part at the address is of this driver
+	int (* initialize)(IOWKIT_HANDLE handle, SHTW1_SENSOR * sensor); // resets the part and sets up its readout, 0 = the part answered
+	int (* trigger)(SHTW1_SENSOR * sensor); // starts a conversion, WriteI2C result, 3 = sent or nothing to send
+	uint32_t (* conversion_time_us)(SHTW1_SENSOR * sensor); // waited out on the PC between trigger and fetch
+	IOWKIT_SPECIAL_REPORT (* fetch)(SHTW1_SENSOR * sensor); // ReadI2c reply with the result
+	uint8_t (* decode)(SHTW1_SENSOR * sensor, IOWKIT_SPECIAL_REPORT * report, uint16_t * temperature_raw, uint16_t * humidity_raw); // DECODE_ERROR flags
+} SENSOR_DRIVER;
+
+// STATIC_CONFIGURATION names a header written by '--generate-table', it holds the sensors table and the index of a fixed
+// configuration as initializers, the binary then starts without reading, parsing or allocating anything for its configuration
+#ifdef STATIC_CONFIGURATION
+#include STATIC_CONFIGURATION
+static int32_t sensor_index[SENSOR_INDEX_SIZE] = STATIC_SENSOR_INDEX;
+#else
+static int32_t sensor_index[SENSOR_INDEX_SIZE]; // stick serial number hash index into the sensors table, -1 = empty slot
+#endif
+
+typedef struct NAME_POOL_CHUNK
+{
+	struct NAME_POOL_CHUNK * next;
+	size_t used;
+	size_t size;
+	char names[];
+} NAME_POOL_CHUNK;
+
+static NAME_POOL_CHUNK * sensor_names = NULL; // names of the loaded configuration, released all at once
+
+enum SWEEP_PHASE
+{
+	PHASE_USB_WRITE = 0,	// measure command transmission
+	PHASE_CONVERSION_WAIT,	// sensor conversion, clock stretching disabled
+	PHASE_USB_READ,		// measurement result transmission
+	PHASE_CRC,
+	PHASE_CONVERSION,	// raw values to T, RH and dew point
+	PHASE_RECOVERY,		// soft resets and bus re-enables of unhealthy sensors
+	PHASE_RECORD_WRITE,
+	PHASE_PLOT_UPDATE,
+	PHASE_CONSOLE_PRINT,
+	NUMBER_OF_SWEEP_PHASES
+};
+
+static const char * sweep_phase_names[NUMBER_OF_SWEEP_PHASES] = {"usb write", "conversion wait", "usb read", "crc", "conversion", "recovery", "record write", "plot update", "console print"};
+
+enum WORKER_LAYOUT
+{
+	WORKERS_SINGLE = 0,	// the acquisition thread sweeps all sticks
+	WORKERS_STICK,		// a worker thread per stick, whatever the USB topology
+	WORKERS_TOPOLOGY,	// workers grouped by USB host controller and hub, at most options.hub_workers per hub
+	NUMBER_OF_WORKER_LAYOUTS
+};
+
+static const char * worker_layout_names[NUMBER_OF_WORKER_LAYOUTS] = {"single", "stick", "topology"};
+
+enum PLOT
+{
+	PLOT_TEMPERATURE = 0,
+	PLOT_HUMIDITY,
+	PLOT_DEW_POINT,
+	NUMBER_OF_PLOTS
+};
+
+typedef struct PLOT_PROCESS
+{
+	FILE * pipe; // plot commands, NULL = not started
+	pid_t pid;
+} PLOT_PROCESS;
+
+typedef struct CONTROL_CLIENT
+{
+	int descriptor; // -1 = free slot
+	char input[CONTROL_LINE_LENGTH]; // received bytes not yet executed
+	size_t input_length;
+	char * output; // reply of the last command, NULL = sent
+	size_t output_length;
+	size_t output_sent;
+} CONTROL_CLIENT;
+
+typedef struct CONTROL_SOCKET
+{
+	int descriptor; // listening socket, -1 = no control socket
+	CONTROL_CLIENT clients[CONTROL_MAX_CLIENTS];
+	PLOT_PROCESS snapshot; // plot process drawing the last requested snapshot
+} CONTROL_SOCKET;
+
+static CONTROL_SOCKET control_socket = { .descriptor = -1, .snapshot = { NULL, -1 } };
+
+static const char * plot_titles[NUMBER_OF_PLOTS] = {"Temperature plot.", "Relative Humidity plot.", "Dew Point plot."};
+static const char * plot_labels[NUMBER_OF_PLOTS] = {"Temperature [*C]", "RH[%]", "Dew_Point[*C]"};
+static const char * plot_ranges[NUMBER_OF_PLOTS] = {"-40:100", "-0:100", "-40:100"};
+
+typedef struct PLOT_WRITER
+{
+	// the on-line plots are formatted and written by their own thread, the acquisition thread only copies a frame of the histories
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t start; // a frame was copied or the writer is stopped
+	int running;
+	int busy; // a frame is copied and not written yet, set by the acquisition thread, cleared by the plot writer
+	double deadline; // CLOCK_MONOTONIC, a frame not written by then is dropped at the shutdown
+	uint32_t skipped_frames; // plot updates dropped because the previous frame was still being written
+	int descriptors[NUMBER_OF_PLOTS]; // write ends of the plot pipes, non-blocking
+	uint16_t number_of_lines; // plotted sensors of the frame
+	char titles[MAX_NUMBER_OF_SENSORS][PLOT_TITLE_LENGTH];
+	uint32_t number_of_samples[MAX_NUMBER_OF_SENSORS];
+	HISTORY_SAMPLE samples[MAX_NUMBER_OF_SENSORS][NUMBER_OF_PLOT_POINTS];
+} PLOT_WRITER;
+
+static PLOT_WRITER plot_writer = { .mutex = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER };
+
+enum CONTROL_COMMAND
+{
+	CONTROL_HELP = 0,
+	CONTROL_LIST,
+	CONTROL_LAST,
+	CONTROL_STATS,
+	CONTROL_HEALTH,
+	CONTROL_RESET,
+	CONTROL_RATE,
+	CONTROL_PLOT,
+	NUMBER_OF_CONTROL_COMMANDS
+};
+
+static const char * control_command_names[NUMBER_OF_CONTROL_COMMANDS] = {"help", "list", "last", "stats", "health", "reset", "rate", "plot"};
+static const char * control_command_usages[NUMBER_OF_CONTROL_COMMANDS] = {"help", "list", "last <sensor> [<samples>]", "stats", "health", "reset <sensor>",
+	"rate <sensor> <period ms>", "plot <png file name>"};
+static const uint8_t control_command_arguments[NUMBER_OF_CONTROL_COMMANDS] = {0, 0, 1, 0, 0, 1, 2, 1}; // required arguments
+
+typedef struct RECORD_STORE
+{
+	FILE * file;
+	char path[MAX_FILE_PATH_LENGTH];
+	uint32_t sequence; // blocks sealed so far
+	uint32_t block_bytes; // records written to the open block
+	uint32_t block_crc;
+	double block_start; // CLOCK_MONOTONIC of the first record of the open block
+	uint64_t synced_bytes;
+} RECORD_STORE;
+
+static uint32_t crc32c_table[256];
+static uint32_t (* Crc32c)(uint32_t crc, const char * data, size_t length); // set by InitializeCrc32c()
+
+typedef struct SWEEP_TIMING
+{
+	double phase_time[NUMBER_OF_SWEEP_PHASES]; // time in seconds spent in every phase during the current sweep
+	double window_phase_time[PHASE_STATS_WINDOW][NUMBER_OF_SWEEP_PHASES];
+	double window_sweep_time[PHASE_STATS_WINDOW];
+	uint32_t window_index;
+	uint32_t window_fill;
+} SWEEP_TIMING;
+
+static SWEEP_TIMING sweep_timing;
+static __thread double * sweep_phase_time = sweep_timing.phase_time; // phases of the calling thread, a sweep worker keeps its own
+
+typedef struct SWEEP_SLOT
+{
+	uint16_t sensor; // index into the sensors table
+	uint16_t stick_rank;
+	uint16_t order; // position in the trigger order
+	double usb_round_trip;
+	double trigger_begin; // CLOCK_MONOTONIC before the trigger
+	double ready; // the conversion ends and the result can be fetched, -1 = trigger failed
+	double conversion_end; // ready of a polled sensor, 0 = the conversion ends inside the fetch
+} SWEEP_SLOT;
+
+typedef struct STICK_TOPOLOGY
+{
+	uint32_t stick_serial_number;
+	int32_t first_sensor; // head of the sensors of the stick in the table
+	uint16_t bus; // USB bus number, one per host controller, 0 = the stick was not found in sysfs
+	char port_path[USB_PORT_PATH_LENGTH]; // sysfs name of the stick, e.g. 1-1.4.2
+	char hub_path[USB_PORT_PATH_LENGTH]; // sysfs name of its hub, e.g. 1-1.4, the root hub of a controller is usb<bus>
+	uint32_t worker;
+} STICK_TOPOLOGY;
+
+typedef struct SWEEP_WORKER
+{
+	pthread_t thread;
+	uint16_t * sensors; // indexes into the sensors table of all sensors on its sticks
+	uint16_t number_of_sensors;
+	SWEEP_SLOT * slots;
+	uint32_t generation; // last sweep started by the worker
+	int result; // of the last sweep
+	double sweep_time; // of the last sweep
+	double phase_time[NUMBER_OF_SWEEP_PHASES]; // of the last sweep
+} SWEEP_WORKER;
+
+// Sweep workers. Every worker thread sweeps the sensors of its own sticks, so the USB transactions of sticks on different
+// host controllers and hubs run in parallel; the acquisition thread starts a sweep of all workers and waits for the last one.
+typedef struct SWEEP_WORKERS
+{
+	SWEEP_WORKER workers[MAX_SWEEP_WORKERS];
+	uint32_t number_of_workers; // 0 = the acquisition thread sweeps all sensors
+	uint32_t number_of_threads; // started so far, kept over the layouts, the ones beyond number_of_workers are idle
+	int layout_changed; // sticks or sensors changed, the workers are laid out again before the next sweep
+	STICK_TOPOLOGY sticks[MAX_NUMBER_OF_SENSORS]; // sticks with bound sensors, by controller and hub
+	uint16_t sensors[MAX_NUMBER_OF_SENSORS]; // sensors of the workers one after another
+	SWEEP_SLOT slots[MAX_NUMBER_OF_SENSORS];
+	SHTW1_SENSOR * sensors_table;
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	uint32_t generation; // sweeps started so far
+	uint32_t pending; // workers still sweeping
+	int running;
+	cpu_set_t cpus; // of the process before the acquisition thread was pinned, the workers run on all of them
+} SWEEP_WORKERS;
+
+static SWEEP_WORKERS sweep_workers = { .layout_changed = 1, .mutex = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+typedef struct TESTSYSTEM_OPTIONS
+{
+	char * configuration_path;
+	char * records_directory;
+	char * plot_command;
+	uint32_t measurement_delay_ms;
+	uint32_t number_of_sweeps; // 0 = measure until 'CTRL' + 'c'
+	char * bench_report_path; // JSON report with throughput, sweep latency and CPU use, NULL = no report
+	int microbench; // run microbenchmarks of the per-sample kernels instead of measuring
+	char * microbench_baseline_path; // baseline compared with microbenchmark results
+	char * microbench_output_path; // file the microbenchmark results are written to, as a new baseline
+	char * trace_path; // Chrome trace event JSON written at exit and on SIGUSR1, NULL = tracing disabled
+	char * generated_table_path; // header with the loaded configuration as a static sensors table, NULL = measure
+	int built_in_configuration; // the sensors table was compiled in, cleared by an explicit configuration file
+	int daemon; // headless: no plots, no console output per sweep, signals read through a signalfd, systemd notifications
+	uint32_t shutdown_deadline_ms;
+	int realtime_priority; // SCHED_FIFO priority of the acquisition thread, 0 = normal scheduling
+	int cpu; // CPU the acquisition thread is pinned to, -1 = any
+	int lock_memory; // mlockall() before measuring, page faults never delay a sweep
+	char * control_socket_path; // UNIX socket for commands of operators, '@' = abstract, NULL = no control socket
+	uint32_t mode_bench_samples; // benchmark the measurement modes on the first bound sensor instead of measuring, 0 = measure
+	uint8_t worker_layout; // WORKER_LAYOUT of the sweep
+	uint32_t hub_workers; // sweep workers per hub of the topology layout
+	char * usb_sysfs_path; // USB devices in sysfs, read by the topology layout
+} TESTSYSTEM_OPTIONS;
+
+static TESTSYSTEM_OPTIONS options = { .configuration_path = CONFIGURATION_FILE, .records_directory = RECORDS_DIRECTORY, .plot_command = PLOT_COMMAND, .measurement_delay_ms = MEASUREMENT_DELAY_MS,
+	.shutdown_deadline_ms = SHUTDOWN_DEADLINE_MS, .cpu = -1, .hub_workers = HUB_MAX_WORKERS, .usb_sysfs_path = USB_SYSFS_DEVICES };
+
+typedef struct BENCH_STATISTICS
+{
+	double configuration_load_time;
+	double discovery_time;
+	double measurement_start;
+	double measurement_stop;
+	uint32_t number_of_bound_sensors;
+	uint32_t number_of_samples;
+	uint32_t number_of_failed_sweeps;
+	uint32_t number_of_recoveries; // recoveries after which the sensor answered again
+	double * sweep_latencies; // whole sweep time of every sweep, in seconds
+	uint32_t number_of_sweeps;
+	uint32_t sweep_latencies_size;
+	double wakeup_latencies[2][WAKEUP_PROBE_SLEEPS]; // oversleep of the probe sleeps before and after the real-time switch, sorted
+	int realtime_probed;
+} BENCH_STATISTICS;
+
+static BENCH_STATISTICS bench_statistics;
+
+typedef struct TIME_ANCHOR
+{
+	double monotonic; // CLOCK_MONOTONIC in the middle of the bracket, in seconds
+	double realtime; // CLOCK_REALTIME read inside the bracket
+	double uncertainty; // half of the bracket width
+} TIME_ANCHOR;
+
+typedef struct TIMING_ANALYZER
+{
+	TIME_ANCHOR anchor;
+	double origin; // realtime of the first anchor, the 'time' column of the result file starts here
+	uint32_t number_of_anchors;
+	double max_anchor_uncertainty;
+	double drift_ppm; // realtime clock rate against the monotonic clock between the two last anchors (NTP slewing)
+	double max_drift_ppm;
+	uint32_t jitter_histogram[JITTER_BINS]; // absolute difference between consecutive sample intervals of a sensor
+	uint32_t number_of_jitters;
+	double max_jitter;
+	uint32_t number_of_samples;
+	double uncertainty_sum; // half of the I2C transaction duration, the sample was taken somewhere inside the transaction
+	double max_uncertainty;
+	pthread_mutex_t mutex; // the sweep workers add their samples at the same time
+} TIMING_ANALYZER;
+
+static TIMING_ANALYZER timing_analyzer = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+// Chrome trace event timeline (chrome://tracing, Perfetto). Every thread records complete events into its own ring
+// buffer without locks, buffers are chained into a list by an atomic push and only read when the trace is dumped.
+enum TRACE_EVENT_NAME
+{
+	TRACE_SWEEP = 0,
+	TRACE_TRANSACTION,	// one sensor: measure command, conversion wait and result read
+	TRACE_RECORD_FLUSH,
+	TRACE_PLOT_FRAME,
+	TRACE_RECOVERY,
+	TRACE_RELOAD,
+	TRACE_USB_STALL,	// from the start of the hung transfer to its cancellation
+	TRACE_STICKS_REOPEN,
+	NUMBER_OF_TRACE_EVENT_NAMES
+};
+
+static const char * trace_event_names[NUMBER_OF_TRACE_EVENT_NAMES] = {"sweep", "i2c transaction", "record flush", "plot frame", "recovery", "configuration reload", "usb stall", "sticks re-open"};
+static const char * trace_event_categories[NUMBER_OF_TRACE_EVENT_NAMES] = {"acquisition", "i2c", "sink", "sink", "i2c", "configuration", "usb", "usb"};
+static const char * trace_argument_names[NUMBER_OF_TRACE_EVENT_NAMES] = {"sweep", "serial", "records", "sensors", "serial", "sensors", "serial", "sticks"};
+
+typedef struct TRACE_EVENT
+{
+	uint64_t start; // CLOCK_MONOTONIC, in nanoseconds
+	uint64_t duration; // in nanoseconds
+	uint32_t argument;
+	uint8_t name;
+} TRACE_EVENT;
+
+typedef struct TRACE_BUFFER
+{
+	struct TRACE_BUFFER * next;
+	pid_t thread_id;
+	const char * thread_name;
+	volatile uint64_t head; // number of events ever recorded, written only by the owner thread
+	TRACE_EVENT events[TRACE_BUFFER_SIZE];
+} TRACE_BUFFER;
+
+static TRACE_BUFFER * volatile trace_buffers = NULL;
+static __thread TRACE_BUFFER * trace_buffer = NULL;
+static uint64_t trace_start = 0;
+static volatile sig_atomic_t trace_dump_requested = 0;
+
 static volatile int infinite_loop_control = 1;
+static volatile sig_atomic_t reload_requested = 0;
 
 void InterruptHandler(int interrupt_signal_dummy)
 {
 	infinite_loop_control = 0;
 }
-
-int VerifyChecksum(uint8_t data[], uint8_t bytes_count, uint8_t received_checksum){
- 	
- 	uint8_t crc = 0xFF; // calculated checksum
-	uint8_t bit_counter = 0; // bit counter
- 	uint8_t byte_counter = 0; // byte counter
-
- 	for(byte_counter = 0; byte_counter < bytes_count; byte_counter++)
- 	{
- 		crc ^= (data[byte_counter]);
- 		for(bit_counter = 8; bit_counter > 0; --bit_counter)
- 		{
- 			if(crc & 0x80) crc = (crc << 1) ^ CRC_POLYNOMIAL;
- 			else crc = (crc << 1);
- 		}
- 	}
-	
- 	// verify checksum
- 	if(crc != received_checksum) return -2;
- 	else return 0;
+
+void ReloadHandler(int interrupt_signal_dummy)
+{
+	(void)interrupt_signal_dummy;
+	reload_requested = 1;
 }
-
-float ConvertTemperature(uint16_t sensor_value){
-	// formula from shtw1 datasheet
- 	return 175 * (float)sensor_value / 65536 - 45;
+
+double GetMonotonicTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec/1000000000;
 }
-
-float ConvertHumidity(uint16_t sensor_value){
-	// formula from shtw1 datasheet
- 	return 100 * (float)sensor_value / 65536;
+
+uint64_t GetMonotonicNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
-IOWKIT_SPECIAL_REPORT ReadI2c(IOWKIT_HANDLE handle, uint8_t count)
+TRACE_BUFFER * GetTraceBuffer(void)
 {
-	IOWKIT_SPECIAL_REPORT report;
-	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
-	short result = 0;
+	// buffer of the calling thread, created on its first event
+	if (trace_buffer) return trace_buffer;
+	trace_buffer = calloc(1, sizeof(TRACE_BUFFER));
+	if (trace_buffer == NULL) return NULL;
+	trace_buffer->thread_id = (pid_t)syscall(SYS_gettid);
+	do trace_buffer->next = trace_buffers;
+	while (!__sync_bool_compare_and_swap(&trace_buffers, trace_buffer->next, trace_buffer));
+	return trace_buffer;
+}
 
-	report.ReportID = 0x03;			// I2C-Read option of EK-H5
-	report.Bytes[0] = count;		// Read 3 Bytes
-	report.Bytes[1] = I2C_READ_COMMAND;	// I2C address + read bit	
+void SetTraceThreadName(const char * thread_name)
+{
+	TRACE_BUFFER * buffer;
+	if (!options.trace_path || (buffer = GetTraceBuffer()) == NULL) return;
+	buffer->thread_name = thread_name;
+}
 
-	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
-	IowKitRead(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+uint64_t TraceStart(void)
+{
+	// start time of an event, the clock is not read when tracing is disabled
+	return options.trace_path ? GetMonotonicNanoseconds() : 0;
+}
 
-	if (report.Bytes[0] & 0x80) 
-		printf("I2C read operation error at address %i.\nSlave did not send ACK after command byte. Possible slave disconnection.\n\n", I2C_READ_COMMAND >> 1);
-	return report;
+void TraceEvent(enum TRACE_EVENT_NAME name, uint64_t start, uint32_t argument)
+{
+	// records an event lasting from start until now
+	TRACE_BUFFER * buffer;
+	TRACE_EVENT * event;
+
+	if (!options.trace_path || (buffer = GetTraceBuffer()) == NULL) return;
+	event = &buffer->events[buffer->head % TRACE_BUFFER_SIZE];
+	event->start = start;
+	event->duration = GetMonotonicNanoseconds() - start;
+	event->argument = argument;
+	event->name = (uint8_t)name;
+	__sync_synchronize(); // the event is complete before it gets published
+	buffer->head++;
 }
 
-int WriteI2C(IOWKIT_HANDLE handle, uint16_t command)
+void TraceDumpHandler(int interrupt_signal_dummy)
 {
-	IOWKIT_SPECIAL_REPORT report;
-	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
-	int8_t last_correctly_transfered_byte = -1;
+	(void)interrupt_signal_dummy;
+	trace_dump_requested = 1;
+}
 
-	report.ReportID = 0x02;		// I2C-Write
-	report.Bytes[0] = 0xC3;		// Generate Start, Write 3 Bytes, Generate stop
-	report.Bytes[1] = I2C_WRITE_COMMAND;	// I2C address of the sensor plus write operation bit
-	report.Bytes[2] = (uint8_t)((command >> 8) & 0xFF);		// upper byte of the command
-	report.Bytes[3] = (uint8_t)(command & 0xFF);			// lower byte of the command	
+int DumpTraceEvents(char * trace_path)
+{
+	TRACE_BUFFER * buffer;
+	TRACE_EVENT * event;
+	uint64_t head, event_index;
+	uint32_t number_of_events = 0;
+	const char * separator = "";
+	FILE * trace_file = fopen(trace_path, "w");
 
-	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
-	IowKitRead(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
-	
-	if (report.Bytes[0] & 0x80)
-	{ 
-		printf("ERROR: I2C write operation at address %i.\nSlave did not acknowledge transfer. Possible slave disconnection.\n", I2C_WRITE_COMMAND >> 1);
-		return -1;
-	}
-	else
+	if (trace_file == NULL)
 	{
-		last_correctly_transfered_byte = (report.Bytes[0]);	// indicates last byte that was succesfuly transfered
-		// all transactions through I2C to SHTC1/SHTW1 are 3 bytes (R/W address byte + 2 bytes of the specific command)		
-		return last_correctly_transfered_byte;		
+		printf("ERROR: Could not create trace file: %s\n", trace_path);
+		return -1;
 	}
-}
 
-int GetSensorId(IOWKIT_HANDLE handle)
-{
-	int8_t sensor_id = -1; // sensor ID is a 6bit value 	
-	if( WriteI2C(handle, READ_ID) == 3)	// I2C command transmission is 3 bytes long, therefore last confirmed should be 3. byte
+	fprintf(trace_file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	for (buffer = trace_buffers; buffer; buffer = buffer->next)
 	{
-		IOWKIT_SPECIAL_REPORT return_report;
-		return_report = ReadI2c(handle, 0x03);
-		if (!(return_report.Bytes[0] & 0x80)) 
+		head = buffer->head;
+		__sync_synchronize();
+		if (buffer->thread_name)
 		{
-			//check CRC
-			if(VerifyChecksum(&return_report.Bytes[1], 2, return_report.Bytes[3])) 	printf("Checksum ERROR\n");
-			else
-			{			
-				//Bits 5 to 0 are SHTC1/SHTW1-specific product code, it should be 000111 for both
-				sensor_id = ((return_report.Bytes[1] << 8) | return_report.Bytes[2]) & 0x3F; 		
-			}		
-		}	
+			fprintf(trace_file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %i, \"tid\": %i, \"args\": {\"name\": \"%s\"}}", separator, getpid(), buffer->thread_id, buffer->thread_name);
+			separator = ",\n";
+		}
+		for (event_index = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE + TRACE_DUMP_MARGIN : 0; event_index < head; event_index++)
+		{
+			event = &buffer->events[event_index % TRACE_BUFFER_SIZE];
+			fprintf(trace_file, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %i, \"tid\": %i, \"args\": {\"%s\": %u}}",
+				separator, trace_event_names[event->name], trace_event_categories[event->name], (double)(event->start - trace_start) / 1000, (double)event->duration / 1000,
+				getpid(), buffer->thread_id, trace_argument_names[event->name], event->argument);
+			separator = ",\n";
+			number_of_events++;
+		}
 	}
-	else printf("READ_ID command transmission ERROR!\n");
-	return sensor_id;
+	fprintf(trace_file, "\n]}\n");
+	fclose(trace_file);
+	printf("Trace of %u events written to: %s\n", number_of_events, trace_path);
+	return 0;
 }
 
-void EnableI2c(IOWKIT_HANDLE handle)
+double MarkSweepPhase(enum SWEEP_PHASE phase, double phase_start)
 {
-	// Enable I2C Mode and set Sensibus ON
-	IOWKIT_SPECIAL_REPORT report;
-	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE); // clearing the report 
-	report.ReportID = 0x01; // I2C-Mode
-	report.Bytes[0] = 0x01; // Enable I2C
-	report.Bytes[1] = 0x80; // Enable Pull-Up resistors, Enable Bus
-	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+	// adds time elapsed since phase_start to the phase, returned value is the start of the next phase
+	double now = GetMonotonicTime();
+	sweep_phase_time[phase] += now - phase_start;
+	return now;
+}
 
+void CloseSweepTiming(double sweep_time)
+{
+	// moves the current sweep into the rolling window
+	memcpy(sweep_timing.window_phase_time[sweep_timing.window_index], sweep_timing.phase_time, sizeof(sweep_timing.phase_time));
+	sweep_timing.window_sweep_time[sweep_timing.window_index] = sweep_time;
+	sweep_timing.window_index = (sweep_timing.window_index + 1) % PHASE_STATS_WINDOW;
+	if (sweep_timing.window_fill < PHASE_STATS_WINDOW) sweep_timing.window_fill++;
+	memset(sweep_timing.phase_time, 0x00, sizeof(sweep_timing.phase_time));
 }
 
-void DisableI2c(IOWKIT_HANDLE handle)
+void PrintSweepTiming(FILE * output)
 {
-	// Disable I2C 
-	IOWKIT_SPECIAL_REPORT report;
-	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
-	report.ReportID = 0x01; // I2C-Mode
-	report.Bytes[0] = 0x00; // Disable I2C
-	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+	uint32_t window_iterator = 0;
+	uint8_t phase = 0;
+	double phase_mean, phase_max, accounted_time = 0.0;
+	double sweep_mean = 0.0, sweep_max = 0.0;
+
+	if (!sweep_timing.window_fill) return;
+
+	for (window_iterator = 0; window_iterator < sweep_timing.window_fill; window_iterator++)
+	{
+		sweep_mean += sweep_timing.window_sweep_time[window_iterator];
+		if (sweep_timing.window_sweep_time[window_iterator] > sweep_max) sweep_max = sweep_timing.window_sweep_time[window_iterator];
+	}
+	sweep_mean /= sweep_timing.window_fill;
+
+	fprintf(output, "\n-- Sweep phase timing, last %u sweeps ----------------------\n", sweep_timing.window_fill);
+	fprintf(output, "   %-16s %10s %10s %7s\n", "phase", "mean[ms]", "max[ms]", "share");
+	for (phase = 0; phase < NUMBER_OF_SWEEP_PHASES; phase++)
+	{
+		phase_mean = 0.0;
+		phase_max = 0.0;
+		for (window_iterator = 0; window_iterator < sweep_timing.window_fill; window_iterator++)
+		{
+			phase_mean += sweep_timing.window_phase_time[window_iterator][phase];
+			if (sweep_timing.window_phase_time[window_iterator][phase] > phase_max) phase_max = sweep_timing.window_phase_time[window_iterator][phase];
+		}
+		phase_mean /= sweep_timing.window_fill;
+		accounted_time += phase_mean;
+		fprintf(output, "   %-16s %10.3f %10.3f %6.1f%%\n", sweep_phase_names[phase], phase_mean * 1000, phase_max * 1000, sweep_mean > 0 ? 100 * phase_mean / sweep_mean : 0.0);
+	}
+	fprintf(output, "   %-16s %10.3f %10s %6.1f%%\n", "other", (sweep_mean - accounted_time) * 1000, "-", sweep_mean > 0 ? 100 * (sweep_mean - accounted_time) / sweep_mean : 0.0);
+	fprintf(output, "   %-16s %10.3f %10.3f\n", "whole sweep", sweep_mean * 1000, sweep_max * 1000);
+	if (sweep_workers.number_of_workers) fprintf(output, "   %u sweep workers (%s layout), the phases are those of the slowest one\n", sweep_workers.number_of_workers,
+		worker_layout_names[options.worker_layout]);
+	if (sweep_mean > 0) fprintf(output, "   Achievable sweep rate without measurement delay: %.1f[Hz]\n", 1.0 / sweep_mean);
+	fprintf(output, "----------------------------------------------------------\n\n");
+}
+
+void SetTimeAnchor(void)
+{
+	// pairs CLOCK_REALTIME with CLOCK_MONOTONIC, the tightest of a few monotonic brackets around a realtime read wins
+	struct timespec realtime;
+	TIME_ANCHOR anchor, best = { .uncertainty = -1.0 };
+	double before, after, predicted;
+	uint8_t trial = 0;
+
+	for (trial = 0; trial < TIME_ANCHOR_TRIALS; trial++)
+	{
+		before = GetMonotonicTime();
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		after = GetMonotonicTime();
+		anchor.monotonic = (before + after) / 2;
+		anchor.realtime = (double)realtime.tv_sec + (double)realtime.tv_nsec/1000000000;
+		anchor.uncertainty = (after - before) / 2;
+		if (best.uncertainty < 0 || anchor.uncertainty < best.uncertainty) best = anchor;
+	}
+
+	if (timing_analyzer.number_of_anchors)
+	{
+		predicted = timing_analyzer.anchor.realtime + (best.monotonic - timing_analyzer.anchor.monotonic);
+		timing_analyzer.drift_ppm = (best.realtime - predicted) / (best.monotonic - timing_analyzer.anchor.monotonic) * 1000000;
+		if (fabs(timing_analyzer.drift_ppm) > fabs(timing_analyzer.max_drift_ppm)) timing_analyzer.max_drift_ppm = timing_analyzer.drift_ppm;
+	}
+	else timing_analyzer.origin = best.realtime;
+
+	timing_analyzer.anchor = best;
+	timing_analyzer.number_of_anchors++;
+	if (best.uncertainty > timing_analyzer.max_anchor_uncertainty) timing_analyzer.max_anchor_uncertainty = best.uncertainty;
+}
+
+double GetRecordTime(double monotonic)
+{
+	// monotonic time converted to seconds since the first anchor on the realtime scale
+	return timing_analyzer.anchor.realtime + (monotonic - timing_analyzer.anchor.monotonic) - timing_analyzer.origin;
+}
+
+uint32_t GetSamplePeriod(SHTW1_SENSOR * sensor)
+{
+	if (!sensor->max_period_ms) return sensor->period_ms;
+	if (sensor->adaptive.period_ms < sensor->period_ms) return sensor->period_ms;
+	if (sensor->adaptive.period_ms > sensor->max_period_ms) return sensor->max_period_ms;
+	return sensor->adaptive.period_ms;
+}
+
+void AddSampleTiming(SHTW1_SENSOR * sensor, double transaction_start, double transaction_stop)
+{
+	// timestamps a valid sample and adds its interval to the jitter analysis
+	double sample_time = (transaction_start + transaction_stop) / 2;
+	double uncertainty = (transaction_stop - transaction_start) / 2;
+	double interval, jitter, delta;
+	uint32_t bin;
+
+	pthread_mutex_lock(&timing_analyzer.mutex);
+	timing_analyzer.number_of_samples++;
+	timing_analyzer.uncertainty_sum += uncertainty;
+	if (uncertainty > timing_analyzer.max_uncertainty) timing_analyzer.max_uncertainty = uncertainty;
+
+	if (sensor->sample_time > 0)
+	{
+		interval = sample_time - sensor->sample_time;
+		if (sensor->number_of_intervals)
+		{
+			if (!sensor->adaptive.period_changed) // a deliberate change of an adaptive period is no jitter
+			{
+				jitter = fabs(interval - sensor->sample_interval);
+				bin = (uint32_t)(jitter * 1000000 / JITTER_BIN_US);
+				timing_analyzer.jitter_histogram[bin < JITTER_BINS ? bin : JITTER_BINS - 1]++;
+				timing_analyzer.number_of_jitters++;
+				if (jitter > timing_analyzer.max_jitter) timing_analyzer.max_jitter = jitter;
+			}
+			if (interval < sensor->interval_min) sensor->interval_min = interval;
+			if (interval > sensor->interval_max) sensor->interval_max = interval;
+		}
+		else sensor->interval_min = sensor->interval_max = interval;
+		sensor->adaptive.period_changed = 0;
+
+		sensor->number_of_intervals++;
+		delta = interval - sensor->interval_mean;
+		sensor->interval_mean += delta / sensor->number_of_intervals;
+		sensor->interval_m2 += delta * (interval - sensor->interval_mean);
+		sensor->sample_interval = interval;
+	}
+	sensor->sample_time = sample_time;
+	pthread_mutex_unlock(&timing_analyzer.mutex);
+}
+
+double GetJitterPercentile(double percentile)
+{
+	// upper edge of the histogram bin holding the percentile, in seconds
+	uint32_t bin = 0, rank, cumulative = 0;
+	if (!timing_analyzer.number_of_jitters) return 0.0;
+	rank = (uint32_t)ceil(percentile / 100 * timing_analyzer.number_of_jitters);
+	if (rank < 1) rank = 1;
+	for (bin = 0; bin < JITTER_BINS - 1; bin++)
+	{
+		cumulative += timing_analyzer.jitter_histogram[bin];
+		if (cumulative >= rank) break;
+	}
+	if (bin == JITTER_BINS - 1 || (double)(bin + 1) * JITTER_BIN_US / 1000000 > timing_analyzer.max_jitter) return timing_analyzer.max_jitter;
+	return (double)(bin + 1) * JITTER_BIN_US / 1000000;
+}
+
+void PrintTimingAnalysis(FILE * output, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	uint16_t sensors_iterator = 0;
+	uint32_t number_of_intervals = 0;
+	double interval_mean = 0.0, interval_m2 = 0.0, interval_min = 0.0, interval_max = 0.0;
+	uint32_t adaptive_sensors = 0, adaptive_samples = 0, saved_samples = 0, speedups = 0, min_period_ms = UINT32_MAX, max_period_ms = 0;
+
+	if (!timing_analyzer.number_of_samples) return;
 
+	// intervals of all sensors pooled, the sensors share the sweep period
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		SHTW1_SENSOR * sensor = &sensors_table[sensors_iterator];
+		double delta;
+		if (!sensor->number_of_intervals) continue;
+		if (!number_of_intervals || sensor->interval_min < interval_min) interval_min = sensor->interval_min;
+		if (sensor->interval_max > interval_max) interval_max = sensor->interval_max;
+		delta = sensor->interval_mean - interval_mean;
+		interval_m2 += sensor->interval_m2 + delta * delta * number_of_intervals * sensor->number_of_intervals / (number_of_intervals + sensor->number_of_intervals);
+		number_of_intervals += sensor->number_of_intervals;
+		interval_mean += delta * sensor->number_of_intervals / number_of_intervals;
+	}
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		SHTW1_SENSOR * sensor = &sensors_table[sensors_iterator];
+		if (!sensor->max_period_ms) continue;
+		adaptive_sensors++;
+		adaptive_samples += sensor->number_of_intervals + (sensor->sample_time > 0);
+		saved_samples += sensor->adaptive.saved_samples;
+		speedups += sensor->adaptive.speedups;
+		if (GetSamplePeriod(sensor) < min_period_ms) min_period_ms = GetSamplePeriod(sensor);
+		if (GetSamplePeriod(sensor) > max_period_ms) max_period_ms = GetSamplePeriod(sensor);
+	}
+
+	fprintf(output, "\n-- Sample timing, %u samples ------------------------------\n", timing_analyzer.number_of_samples);
+	if (number_of_intervals)
+		fprintf(output, "   interval[ms]:  mean %.3f, stddev %.3f, min %.3f, max %.3f\n", interval_mean * 1000, sqrt(interval_m2 / number_of_intervals) * 1000, interval_min * 1000, interval_max * 1000);
+	fprintf(output, "   jitter[ms]:    p50 %.1f, p90 %.1f, p99 %.1f, max %.3f (interval to interval, %u[us] bins)\n", GetJitterPercentile(50) * 1000,
+		GetJitterPercentile(90) * 1000, GetJitterPercentile(99) * 1000, timing_analyzer.max_jitter * 1000, JITTER_BIN_US);
+	fprintf(output, "   timestamp uncertainty[ms]: mean %.3f, max %.3f (half of the I2C transaction)\n",
+		timing_analyzer.uncertainty_sum / timing_analyzer.number_of_samples * 1000, timing_analyzer.max_uncertainty * 1000);
+	fprintf(output, "   realtime anchor: %u anchors, uncertainty max %.3f[us], drift %.2f[ppm], max %.2f[ppm]\n", timing_analyzer.number_of_anchors,
+		timing_analyzer.max_anchor_uncertainty * 1000000, timing_analyzer.drift_ppm, timing_analyzer.max_drift_ppm);
+	if (adaptive_sensors)
+		fprintf(output, "   adaptive sampling: %u sensors, periods now %u-%u[ms], %u samples taken, %u (%.1f%%) saved, %u switches to the fastest period\n",
+			adaptive_sensors, min_period_ms, max_period_ms, adaptive_samples, saved_samples,
+			saved_samples ? 100.0 * saved_samples / (saved_samples + adaptive_samples) : 0.0, speedups);
+	fprintf(output, "----------------------------------------------------------\n\n");
+}
+
+int VerifyChecksum(uint8_t data[], uint8_t bytes_count, uint8_t received_checksum){
+ 	
+ 	uint8_t crc = 0xFF; // calculated checksum
+	uint8_t bit_counter = 0; // bit counter
+ 	uint8_t byte_counter = 0; // byte counter
+
+ 	for(byte_counter = 0; byte_counter < bytes_count; byte_counter++)
+ 	{
+ 		crc ^= (data[byte_counter]);
+ 		for(bit_counter = 8; bit_counter > 0; --bit_counter)
+ 		{
+ 			if(crc & 0x80) crc = (crc << 1) ^ CRC_POLYNOMIAL;
+ 			else crc = (crc << 1);
+ 		}
+ 	}
+	
+ 	// verify checksum
+ 	if(crc != received_checksum) return -2;
+ 	else return 0;
+}
+
+float ConvertTemperature(uint16_t sensor_value){
+	// formula from shtw1 datasheet
+ 	return 175 * (float)sensor_value / 65536 - 45;
+}
+
+float ConvertHumidity(uint16_t sensor_value){
+	// formula from shtw1 datasheet
+ 	return 100 * (float)sensor_value / 65536;
 }
 
-int GetMeasurements(IOWKIT_HANDLE handle, float * temperature, float * humidity, float * dew_point)
+float CalculateDewPoint(float temperature, float humidity)
 {
 	float Tn = 0.0;
 	float m = 0.0;
-	float T = 0.0;
-	float RH = 0.0;	
+
+	if (temperature > 0) 
+	{
+		Tn = T_PLUS;
+		m = M_PLUS;
+	}
+	else
+	{
+		Tn = T_MINUS;
+		m = M_MINUS;	
+	}
+
+	// Formula from SHT7x datasheet page 8.
+	return Tn * ( logf( humidity / 100.0 ) + m*temperature / (Tn + temperature) ) / ( m - logf( humidity / 100.0 ) - m*temperature / (Tn + temperature) );
+}
+
+// USB watchdog. Every thread making USB transfers arms its own slot with a deadline before a report transfer, a watchdog
+// thread cancels a transfer still in flight after its deadline, so a hung stick cannot stop the sweeps.
+typedef struct USB_WATCHDOG_SLOT
+{
+	volatile uint64_t deadline; // CLOCK_MONOTONIC nanoseconds, 0 = no transfer in flight, USB_WATCHDOG_CANCELLED = cancelled
+	uint64_t armed; // start of the transfer in flight
+	IOWKIT_HANDLE handle; // stick of the transfer in flight
+	uint32_t stalls; // of the transfers of the thread
+} USB_WATCHDOG_SLOT;
+
+typedef struct USB_WATCHDOG
+{
+	pthread_t thread;
+	pthread_mutex_t mutex; // a transfer is cancelled and disarmed under it, a late cancel never hits the next transfer
+	USB_WATCHDOG_SLOT slots[MAX_SWEEP_WORKERS + 1]; // the acquisition thread, then the sweep workers
+	volatile int running;
+	volatile int reopen_requested; // a stick did not recover from a stall, all sticks are re-opened after the sweep
+	uint32_t stalls;
+	double max_stall_time;
+	uint32_t reopens;
+	double reopen_time; // total time of the re-opens including the sensors binding
+	double max_reopen_time;
+} USB_WATCHDOG;
+
+static USB_WATCHDOG usb_watchdog = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+static __thread USB_WATCHDOG_SLOT * usb_watchdog_slot = &usb_watchdog.slots[0]; // set by a sweep worker to its own slot
+
+void ArmUsbWatchdog(IOWKIT_HANDLE handle)
+{
+	USB_WATCHDOG_SLOT * slot = usb_watchdog_slot;
+	slot->handle = handle;
+	slot->armed = GetMonotonicNanoseconds();
+	__sync_synchronize();
+	slot->deadline = slot->armed + USB_STALL_TIMEOUT_MS * 1000000ull;
+}
+
+int DisarmUsbWatchdog(uint32_t stick_serial_number)
+{
+	// returns 1 when the transfer was cancelled, the stall is recorded with the stick serial number
+	USB_WATCHDOG_SLOT * slot = usb_watchdog_slot;
+	uint64_t deadline;
+	double stall_time = 0.0;
+
+	pthread_mutex_lock(&usb_watchdog.mutex);
+	deadline = slot->deadline;
+	slot->deadline = 0;
+	if (deadline == USB_WATCHDOG_CANCELLED)
+	{
+		stall_time = (GetMonotonicNanoseconds() - slot->armed) / 1e9;
+		slot->stalls++;
+		usb_watchdog.stalls++;
+		if (stall_time > usb_watchdog.max_stall_time) usb_watchdog.max_stall_time = stall_time;
+	}
+	pthread_mutex_unlock(&usb_watchdog.mutex);
+	if (deadline != USB_WATCHDOG_CANCELLED) return 0;
+
+	TraceEvent(TRACE_USB_STALL, slot->armed, stick_serial_number);
+	PROBE2(usb_stall, stick_serial_number, (uint32_t)(stall_time * 1000));
+	printf("ERROR: USB transfer stalled on USB Stick S/N (dec) %u, cancelled after %.0f[ms].\n", stick_serial_number, stall_time * 1000);
+	return 1;
+}
+
+void * UsbWatchdogThread(void * dummy)
+{
+	USB_WATCHDOG_SLOT * slot;
+	uint64_t deadline, now;
+
+	(void)dummy;
+	SetTraceThreadName("usb watchdog");
+	while (usb_watchdog.running)
+	{
+		usleep(USB_WATCHDOG_PERIOD_MS * 1000);
+		now = GetMonotonicNanoseconds();
+		for (slot = usb_watchdog.slots; slot < usb_watchdog.slots + MAX_SWEEP_WORKERS + 1; slot++)
+		{
+			deadline = slot->deadline;
+			if (deadline <= USB_WATCHDOG_CANCELLED || now < deadline) continue;
+			pthread_mutex_lock(&usb_watchdog.mutex);
+			if (slot->deadline == deadline)
+			{
+				slot->deadline = USB_WATCHDOG_CANCELLED;
+				IowKitCancelIo(slot->handle, IOW_PIPE_SPECIAL_MODE);
+			}
+			pthread_mutex_unlock(&usb_watchdog.mutex);
+		}
+	}
+	return NULL;
+}
+
+int StartUsbWatchdog(void)
+{
+	usb_watchdog.running = 1;
+	if (pthread_create(&usb_watchdog.thread, NULL, UsbWatchdogThread, NULL))
+	{
+		usb_watchdog.running = 0;
+		printf("ERROR: Could not start the USB watchdog, a hung stick will stop the measurements.\n");
+		return -1;
+	}
+	return 0;
+}
+
+void StopUsbWatchdog(void)
+{
+	if (!usb_watchdog.running) return;
+	usb_watchdog.running = 0;
+	pthread_join(usb_watchdog.thread, NULL);
+}
+
+IOWKIT_SPECIAL_REPORT ReadI2c(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address, uint8_t count)
+{
+	IOWKIT_SPECIAL_REPORT report;
+	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+
+	PROBE2(read_i2c_entry, stick_serial_number, count);
+
+	report.ReportID = 0x03;			// I2C-Read option of EK-H5
+	report.Bytes[0] = count;		// Read 3 Bytes
+	report.Bytes[1] = (uint8_t)((i2c_address << 1) | 0x01);	// I2C address + read bit	
+
+	ArmUsbWatchdog(handle);
+	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+	if (IowKitRead(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE) != IOWKIT_SPECIAL_REPORT_SIZE)
+	{
+		memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+		report.Bytes[0] = I2C_REPORT_TIMEOUT;
+	}
+	if (DisarmUsbWatchdog(stick_serial_number) && report.Bytes[0] == I2C_REPORT_TIMEOUT) report.Bytes[0] = I2C_REPORT_STALL;
+
+	PROBE2(read_i2c_return, stick_serial_number, report.Bytes[0]);
+
+	if (report.Bytes[0] == I2C_REPORT_TIMEOUT)
+		printf("ERROR: I2C read operation timeout, no reply from USB Stick S/N (dec) %u.\n", stick_serial_number);
+	else if (report.Bytes[0] & 0x80) 
+		printf("I2C read operation error at address %i.\nSlave did not send ACK after command byte. Possible slave disconnection.\n\n", i2c_address);
+	return report;
+}
+
+int WriteI2C(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address, uint16_t command)
+{
+	IOWKIT_SPECIAL_REPORT report;
+	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+	int8_t last_correctly_transfered_byte = -1;
+
+	PROBE2(write_i2c_entry, stick_serial_number, command);
+
+	report.ReportID = 0x02;		// I2C-Write
+	report.Bytes[0] = 0xC3;		// Generate Start, Write 3 Bytes, Generate stop
+	report.Bytes[1] = (uint8_t)(i2c_address << 1);	// I2C address of the sensor plus write operation bit
+	report.Bytes[2] = (uint8_t)((command >> 8) & 0xFF);		// upper byte of the command
+	report.Bytes[3] = (uint8_t)(command & 0xFF);			// lower byte of the command	
+
+	ArmUsbWatchdog(handle);
+	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+	if (IowKitRead(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE) != IOWKIT_SPECIAL_REPORT_SIZE)
+	{
+		if (DisarmUsbWatchdog(stick_serial_number))
+		{
+			PROBE3(write_i2c_return, stick_serial_number, command, I2C_REPORT_STALL);
+			return -3;
+		}
+		PROBE3(write_i2c_return, stick_serial_number, command, I2C_REPORT_TIMEOUT);
+		printf("ERROR: I2C write operation timeout, no reply from USB Stick S/N (dec) %u.\n", stick_serial_number);
+		return -2;
+	}
+	DisarmUsbWatchdog(stick_serial_number);
+
+	PROBE3(write_i2c_return, stick_serial_number, command, report.Bytes[0]);
 	
-	if (WriteI2C(handle, MEASURE_T_RH_CLKSTR) != 3)
+	if (report.Bytes[0] & 0x80)
+	{ 
+		printf("ERROR: I2C write operation at address %i.\nSlave did not acknowledge transfer. Possible slave disconnection.\n", i2c_address);
+		return -1;
+	}
+	else
+	{
+		last_correctly_transfered_byte = (report.Bytes[0]);	// indicates last byte that was succesfuly transfered
+		// all transactions through I2C to SHTC1/SHTW1 are 3 bytes (R/W address byte + 2 bytes of the specific command)		
+		return last_correctly_transfered_byte;		
+	}
+}
+
+int GetSensorId(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address)
+{
+	int8_t sensor_id = -1; // sensor ID is a 6bit value 	
+	if( WriteI2C(handle, stick_serial_number, i2c_address, READ_ID) == 3)	// I2C command transmission is 3 bytes long, therefore last confirmed should be 3. byte
+	{
+		IOWKIT_SPECIAL_REPORT return_report;
+		return_report = ReadI2c(handle, stick_serial_number, i2c_address, 0x03);
+		if (!(return_report.Bytes[0] & 0x80)) 
+		{
+			//check CRC
+			if(VerifyChecksum(&return_report.Bytes[1], 2, return_report.Bytes[3])) 	printf("Checksum ERROR\n");
+			else
+			{			
+				//Bits 5 to 0 are SHTC1/SHTW1-specific product code, it should be 000111 for both
+				sensor_id = ((return_report.Bytes[1] << 8) | return_report.Bytes[2]) & 0x3F; 		
+			}		
+		}	
+	}
+	else printf("READ_ID command transmission ERROR!\n");
+	return sensor_id;
+}
+
+const I2C_CLOCK_SETTING * FindI2cClock(uint32_t product_id, uint16_t clock_khz)
+{
+	// clock_khz 0 = the default clock of the product, NULL = clock not supported by the stick
+	uint8_t setting;
+	for (setting = 0; setting < sizeof(i2c_clock_settings) / sizeof(i2c_clock_settings[0]); setting++)
+		if (i2c_clock_settings[setting].product_id == product_id && (!clock_khz || i2c_clock_settings[setting].clock_khz == clock_khz)) return &i2c_clock_settings[setting];
+	return NULL;
+}
+
+void EnableI2c(IOWKIT_HANDLE handle, uint16_t clock_khz)
+{
+	// Enable I2C Mode and set Sensibus ON, an unsupported clock leaves the stick at its default
+	IOWKIT_SPECIAL_REPORT report;
+	const I2C_CLOCK_SETTING * clock = FindI2cClock(IowKitGetProductId(handle), clock_khz);
+	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE); // clearing the report 
+	report.ReportID = 0x01; // I2C-Mode
+	report.Bytes[0] = 0x01; // Enable I2C
+	report.Bytes[1] = 0x80; // Enable Pull-Up resistors, Enable Bus
+	if (clock && clock->code != I2C_CLOCK_FIXED) report.Bytes[2] = clock->code; // I2C clock
+	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+
+}
+
+void DisableI2c(IOWKIT_HANDLE handle)
+{
+	// Disable I2C 
+	IOWKIT_SPECIAL_REPORT report;
+	memset(&report, 0x00, IOWKIT_SPECIAL_REPORT_SIZE);
+	report.ReportID = 0x01; // I2C-Mode
+	report.Bytes[0] = 0x00; // Disable I2C
+	IowKitWrite(handle, IOW_PIPE_SPECIAL_MODE, (char*) &report, IOWKIT_SPECIAL_REPORT_SIZE);
+
+}
+
+int GetMeasurements(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address, float * temperature, float * humidity, float * dew_point)
+{
+	if (WriteI2C(handle, stick_serial_number, i2c_address, MEASURE_T_RH_CLKSTR) != 3)
 	{
 		printf("I2C operation ERROR while writing measure command!\n");
 		return -1;
@@ -221,7 +1473,7 @@ int GetMeasurements(IOWKIT_HANDLE handle, float * temperature, float * humidity,
 	else
 	{
 		IOWKIT_SPECIAL_REPORT return_report;
-		return_report = ReadI2c(handle, 0x06);
+		return_report = ReadI2c(handle, stick_serial_number, i2c_address, 0x06);
 		if (!(return_report.Bytes[0] & 0x80)) 
 		{
 			// Check CRC for Temperature data - 2 bytes of the report.Bytes[]
@@ -243,26 +1495,7 @@ int GetMeasurements(IOWKIT_HANDLE handle, float * temperature, float * humidity,
 				else
 				{			
 					* humidity = ConvertHumidity((return_report.Bytes[4] << 8) | return_report.Bytes[5]);
-					if (* humidity > 0.0)
-					{
-						if (* temperature > 0) 
-						{
-							Tn = T_PLUS;
-							m = M_PLUS;
-						}
-
-						else
-						{
-							Tn = T_MINUS;
-							m = M_MINUS;	
-						}
-				
-						T = * temperature;
-						RH = * humidity;
-
-						// Formula from SHT7x datasheet page 8.				
-						* dew_point = Tn * ( logf( RH / 100.0 ) + m*T / (Tn + T) ) / ( m - logf( RH / 100.0 ) - m*T / (Tn + T) );
-					}
+					if (* humidity > 0.0) * dew_point = CalculateDewPoint(* temperature, * humidity);
 					return 0;	
 				} 		
 			}				
@@ -271,9 +1504,9 @@ int GetMeasurements(IOWKIT_HANDLE handle, float * temperature, float * humidity,
 	}		
 }
 
-int SendSoftReset(IOWKIT_HANDLE handle)
+int SendSoftReset(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address)
 {	
-	if (WriteI2C(handle, SOFT_RESET) == 3) return 0; // I2C command transmission is 3 bytes long, therefore last confirmed should be 3. byte
+	if (WriteI2C(handle, stick_serial_number, i2c_address, SOFT_RESET) == 3) return 0; // I2C command transmission is 3 bytes long, therefore last confirmed should be 3. byte
 	else
 	{
 		//TODO: here should come transmission error handling, retransmission or whatever
@@ -281,482 +1514,4025 @@ int SendSoftReset(IOWKIT_HANDLE handle)
 	}
 }
 
-uint32_t GetUsbStickSerialNumber(IOWKIT_HANDLE handle)
+int Shtc1Identify(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address)
 {
-	uint32_t serial_number_int = 0;	
-	uint16_t serial_number_unicode[9] = {0};
-	char serial_number_string[9] = {0};
-	int j = 0;
+	return (GetSensorId(handle, stick_serial_number, i2c_address) == SHTC1_PRODUCT_CODE) ? 0 : -1;
+}
 
-	// Get hexadecimal serial number of device in a 16bit unicode string (according to IOW24_40 datasheet and iowkit1.5 API manual)
-	IowKitGetSerialNumber(handle, serial_number_unicode);
+int Shtc1Initialize(IOWKIT_HANDLE handle, SHTW1_SENSOR * sensor)
+{
+	SendSoftReset(handle, sensor->stick_serial_number, sensor->i2c_address);
+	usleep(SOFT_RESET_TIME_US);
+	return Shtc1Identify(handle, sensor->stick_serial_number, sensor->i2c_address);
+}
 
-	for (j = 0; j < 9; j++) serial_number_string[j] = serial_number_unicode[j];
-	
-	serial_number_int = (uint32_t)strtol(serial_number_string, NULL, 16);
+int Shtc1Trigger(SHTW1_SENSOR * sensor)
+{
+	uint8_t readout = (sensor->readout == READOUT_CLOCK_STRETCHING) ? READOUT_CLOCK_STRETCHING : READOUT_POLLING;
+	return WriteI2C(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, measurement_commands[sensor->measurement_mode][readout][sensor->channels]);
+}
+
+uint32_t Shtc1ConversionTime(SHTW1_SENSOR * sensor)
+{
+	return (sensor->readout == READOUT_CLOCK_STRETCHING) ? 0 : conversion_times_us[sensor->measurement_mode];
+}
+
+IOWKIT_SPECIAL_REPORT Shtc1Fetch(SHTW1_SENSOR * sensor)
+{
+	return ReadI2c(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, channel_read_counts[sensor->channels]);
+}
+
+uint8_t Shtc1Decode(SHTW1_SENSOR * sensor, IOWKIT_SPECIAL_REPORT * report, uint16_t * temperature_raw, uint16_t * humidity_raw)
+{
+	// a single channel is the first word, RH first for the humidity
+	uint8_t errors = 0;
+	if (sensor->channels == CHANNEL_RH)
+	{
+		* humidity_raw = (report->Bytes[1] << 8) | report->Bytes[2];
+		return VerifyChecksum(&report->Bytes[1], 2, report->Bytes[3]) ? DECODE_RH_CRC : 0;
+	}
+	* temperature_raw = (report->Bytes[1] << 8) | report->Bytes[2];
+	if (VerifyChecksum(&report->Bytes[1], 2, report->Bytes[3])) errors |= DECODE_T_CRC;
+	if (sensor->channels == CHANNELS_T_RH)
+	{
+		* humidity_raw = (report->Bytes[4] << 8) | report->Bytes[5];
+		if (VerifyChecksum(&report->Bytes[4], 2, report->Bytes[6])) errors |= DECODE_RH_CRC;
+	}
+	return errors;
+}
+
+int Sht3xIdentify(IOWKIT_HANDLE handle, uint32_t stick_serial_number, uint8_t i2c_address)
+{
+	IOWKIT_SPECIAL_REPORT return_report;
+	if (WriteI2C(handle, stick_serial_number, i2c_address, SHT3X_READ_STATUS) != 3)
+	{
+		printf("READ_STATUS command transmission ERROR!\n");
+		return -1;
+	}
+	return_report = ReadI2c(handle, stick_serial_number, i2c_address, 0x03);
+	if ((return_report.Bytes[0] & 0x80) || VerifyChecksum(&return_report.Bytes[1], 2, return_report.Bytes[3])) return -1;
+	return 0;
+}
+
+uint8_t Sht3xPeriodicRate(SHTW1_SENSOR * sensor)
+{
+	// the slowest rate that still has a new measurement for every sample, period=0 measures at 10 per second
+	uint8_t rate;
+	for (rate = 0; rate < SHT3X_PERIODIC_RATES - 1; rate++) if (sensor->period_ms && sht3x_periodic_intervals_ms[rate] <= sensor->period_ms) break;
+	return rate;
+}
+
+int Sht3xInitialize(IOWKIT_HANDLE handle, SHTW1_SENSOR * sensor)
+{
+	// a part left in the periodic mode takes no soft reset, it is stopped first
+	WriteI2C(handle, sensor->stick_serial_number, sensor->i2c_address, SHT3X_BREAK);
+	usleep(SHT3X_BREAK_TIME_US);
+	if (WriteI2C(handle, sensor->stick_serial_number, sensor->i2c_address, SHT3X_SOFT_RESET) != 3) return -1;
+	usleep(SHT3X_SOFT_RESET_TIME_US);
+	if (Sht3xIdentify(handle, sensor->stick_serial_number, sensor->i2c_address)) return -1;
+	if (sensor->readout != READOUT_PERIODIC) return 0;
+	return (WriteI2C(handle, sensor->stick_serial_number, sensor->i2c_address, sht3x_periodic_commands[sensor->measurement_mode][Sht3xPeriodicRate(sensor)]) == 3) ? 0 : -1;
+}
+
+int Sht3xTrigger(SHTW1_SENSOR * sensor)
+{
+	if (sensor->readout == READOUT_PERIODIC) return 3; // the sensor measures on its own
+	return WriteI2C(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, sht3x_single_shot_commands[sensor->measurement_mode][sensor->readout]);
+}
+
+uint32_t Sht3xConversionTime(SHTW1_SENSOR * sensor)
+{
+	return (sensor->readout == READOUT_POLLING) ? sht3x_conversion_times_us[sensor->measurement_mode] : 0;
+}
+
+IOWKIT_SPECIAL_REPORT Sht3xFetch(SHTW1_SENSOR * sensor)
+{
+	IOWKIT_SPECIAL_REPORT return_report;
+	int write_result;
+	uint8_t count = (sensor->channels == CHANNEL_T) ? 3 : 6; // T comes first, the humidity alone is still a 6 byte read
+
+	if (sensor->readout != READOUT_PERIODIC) return ReadI2c(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, count);
+
+	if ((write_result = WriteI2C(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, SHT3X_FETCH_DATA)) != 3)
+	{
+		memset(&return_report, 0x00, sizeof(return_report));
+		return_report.Bytes[0] = (write_result == -3) ? I2C_REPORT_STALL : (write_result == -2) ? I2C_REPORT_TIMEOUT : 0x80;
+		return return_report;
+	}
+	return_report = ReadI2c(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address, count);
+	// the part acknowledged the fetch command, so a read header not acknowledged only means the next measurement is not ready
+	if ((return_report.Bytes[0] & 0x80) && return_report.Bytes[0] != I2C_REPORT_TIMEOUT && return_report.Bytes[0] != I2C_REPORT_STALL) return_report.Bytes[0] = I2C_REPORT_NO_DATA;
+	return return_report;
+}
+
+uint8_t Sht3xDecode(SHTW1_SENSOR * sensor, IOWKIT_SPECIAL_REPORT * report, uint16_t * temperature_raw, uint16_t * humidity_raw)
+{
+	uint8_t errors = 0;
+	if (sensor->channels != CHANNEL_RH)
+	{
+		* temperature_raw = (report->Bytes[1] << 8) | report->Bytes[2];
+		if (VerifyChecksum(&report->Bytes[1], 2, report->Bytes[3])) errors |= DECODE_T_CRC;
+	}
+	if (sensor->channels != CHANNEL_T)
+	{
+		* humidity_raw = (report->Bytes[4] << 8) | report->Bytes[5];
+		if (VerifyChecksum(&report->Bytes[4], 2, report->Bytes[6])) errors |= DECODE_RH_CRC;
+	}
+	return errors;
+}
+
+// tried in this order when a sensor is bound, the first one that initializes the part drives it
+static const SENSOR_DRIVER sensor_drivers[] =
+{
+	{"SHTW1/SHTC1", (1 << READOUT_POLLING) | (1 << READOUT_CLOCK_STRETCHING), Shtc1Identify, Shtc1Initialize, Shtc1Trigger, Shtc1ConversionTime, Shtc1Fetch, Shtc1Decode},
+	{"SHT3x", (1 << READOUT_POLLING) | (1 << READOUT_CLOCK_STRETCHING) | (1 << READOUT_PERIODIC), Sht3xIdentify, Sht3xInitialize, Sht3xTrigger, Sht3xConversionTime, Sht3xFetch, Sht3xDecode}
+};
+
+uint32_t GetUsbStickSerialNumber(IOWKIT_HANDLE handle)
+{
+	uint32_t serial_number_int = 0;	
+	uint16_t serial_number_unicode[9] = {0};
+	char serial_number_string[9] = {0};
+	int j = 0;
+
+	// Get hexadecimal serial number of device in a 16bit unicode string (according to IOW24_40 datasheet and iowkit1.5 API manual)
+	IowKitGetSerialNumber(handle, serial_number_unicode);
+
+	for (j = 0; j < 9; j++) serial_number_string[j] = serial_number_unicode[j];
+	
+	serial_number_int = (uint32_t)strtol(serial_number_string, NULL, 16);
+
+	//printf("S/N (hex) of the io-warrior device: %s\n", serial_number_string);
+
+	return serial_number_int;
+}
+
+void GetResultFilePath(struct tm tm, char file_path_string[])
+{
+	char file_name_string[30];
+
+	strftime(file_name_string, 30, "%Y_%b_%d_%H_%M_%S\0", &tm);
+	snprintf(file_path_string, MAX_FILE_PATH_LENGTH, "%s/%s", options.records_directory, file_name_string);
+}
+
+int IsPlainName(const char * name, size_t length)
+{
+	// letters, digits, '_', '.' and '-' only: safe inside gnuplot strings and shell commands
+	if (!length) return 0;
+	while (length--) if (!isalnum((unsigned char)name[length]) && name[length] != '_' && name[length] != '.' && name[length] != '-') return 0;
+	return 1;
+}
+
+uint32_t Crc32cSoftware(uint32_t crc, const char * data, size_t length)
+{
+	crc = ~crc;
+	while (length--) crc = crc32c_table[(crc ^ (uint8_t)* data++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__ ((target("sse4.2"))) uint32_t Crc32cHardware(uint32_t crc, const char * data, size_t length)
+{
+	// SSE4.2 crc32 instruction, 8 bytes per instruction
+	uint64_t crc_64 = ~crc & 0xFFFFFFFF;
+	uint64_t word;
+
+	for (; length >= 8; data += 8, length -= 8)
+	{
+		memcpy(&word, data, sizeof(word));
+		crc_64 = __builtin_ia32_crc32di(crc_64, word);
+	}
+	crc = (uint32_t)crc_64;
+	while (length--) crc = __builtin_ia32_crc32qi(crc, (uint8_t)* data++);
+	return ~crc;
+}
+#endif
+
+void InitializeCrc32c(void)
+{
+	// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), the CPU instruction is used when available
+	uint32_t byte, bit, crc;
+
+	for (byte = 0; byte < 256; byte++)
+	{
+		for (crc = byte, bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+		crc32c_table[byte] = crc;
+	}
+	Crc32c = Crc32cSoftware;
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2")) Crc32c = Crc32cHardware;
+#endif
+}
+
+int CloseRecordBlock(RECORD_STORE * store)
+{
+	// the trailer seals the records written since the previous one, the block is synced before the next one starts
+	int status = 0;
+
+	if (!store->block_bytes) return fflush(store->file);
+	fprintf(store->file, RECORD_BLOCK_TRAILER, store->sequence, store->block_bytes, store->block_crc);
+	status |= fflush(store->file);
+	status |= fdatasync(fileno(store->file));
+	store->sequence++;
+	store->synced_bytes += store->block_bytes;
+	store->block_bytes = 0;
+	store->block_crc = 0;
+	return status;
+}
+
+int AppendRecord(RECORD_STORE * store, const char * record, size_t length)
+{
+	if (store->block_bytes && store->block_bytes + length > RECORD_BLOCK_MAX_BYTES) CloseRecordBlock(store);
+	if (!store->block_bytes) store->block_start = GetMonotonicTime();
+	store->block_crc = Crc32c(store->block_crc, record, length);
+	store->block_bytes += length;
+	return fwrite(record, 1, length, store->file) == length ? 0 : -1;
+}
+
+int RecoverRecordFile(const char * path)
+{
+	// a power cut can tear only the unsynced open block, so the last valid trailer is within the last
+	// RECORD_BLOCK_MAX_BYTES + RECORD_TRAILER_MAX_LENGTH bytes, everything after it is cut off
+	static char tail[2 * (RECORD_BLOCK_MAX_BYTES + RECORD_TRAILER_MAX_LENGTH) + 1], block[RECORD_BLOCK_MAX_BYTES];
+	struct stat file_status;
+	off_t tail_offset = 0, valid_size = -1;
+	ssize_t tail_length = 0;
+	char * trailer = NULL;
+	uint32_t sequence = 0, block_bytes = 0, block_crc = 0;
+	int trailer_length = 0;
+	int file_descriptor = open(path, O_RDWR);
+
+	if (file_descriptor < 0 || fstat(file_descriptor, &file_status))
+	{
+		printf("ERROR: Could not open the interrupted result file: %s\n", path);
+		if (file_descriptor >= 0) close(file_descriptor);
+		return -1;
+	}
+	tail_offset = file_status.st_size > (off_t)sizeof(tail) - 1 ? file_status.st_size - (off_t)sizeof(tail) + 1 : 0;
+	tail_length = pread(file_descriptor, tail, file_status.st_size - tail_offset, tail_offset);
+	if (tail_length < 0) tail_length = 0;
+	tail[tail_length] = 0;
+
+	for (trailer = tail + tail_length - 1; trailer >= tail && valid_size < 0; trailer--)
+	{
+		if (* trailer != '#' || (trailer > tail && trailer[-1] != '\n') || (trailer == tail && tail_offset)) continue;
+		if (sscanf(trailer, RECORD_BLOCK_TRAILER "%n", &sequence, &block_bytes, &block_crc, &trailer_length) != 3 || !trailer_length) continue;
+		if (trailer[trailer_length - 1] != '\n' || block_bytes > RECORD_BLOCK_MAX_BYTES || (off_t)block_bytes > tail_offset + (trailer - tail)) continue;
+		if (pread(file_descriptor, block, block_bytes, tail_offset + (trailer - tail) - block_bytes) != (ssize_t)block_bytes) continue;
+		if (Crc32c(0, block, block_bytes) == block_crc) valid_size = tail_offset + (trailer - tail) + trailer_length;
+		trailer_length = 0;
+	}
+	if (valid_size < 0 && !tail_offset) valid_size = 0; // the whole file was the first, unsynced block
+
+	if (valid_size < 0) printf("ERROR: No valid record block at the end of the interrupted result file %s, it is left as it is.\n", path);
+	else if (valid_size < file_status.st_size)
+	{
+		if (ftruncate(file_descriptor, valid_size) || fsync(file_descriptor)) valid_size = -1;
+		printf("Interrupted result file %s: %lld bytes of a torn tail cut off after block %u.\n", path, (long long)(file_status.st_size - valid_size), sequence);
+	}
+	else printf("Interrupted result file %s: all blocks are valid.\n", path);
+	close(file_descriptor);
+	return valid_size < 0 ? -1 : 0;
+}
+
+int OpenRecordStore(RECORD_STORE * store, struct tm tm)
+{
+	// the marker names the result file being written, it is left behind by a crash and the file is repaired on the next start;
+	// it holds only the file name, the records directory may be relative to another working directory after a restart
+	char marker_path[MAX_FILE_PATH_LENGTH], interrupted_name[MAX_FILE_PATH_LENGTH], interrupted_path[MAX_FILE_PATH_LENGTH];
+	char * file_name = NULL;
+	FILE * marker_file = NULL;
+
+	mkdir(options.records_directory, 0777); // create a directory for output files 
+	memset(store, 0x00, sizeof(RECORD_STORE));
+	snprintf(marker_path, sizeof(marker_path), "%s/%s", options.records_directory, RECORDS_OPEN_MARKER);
+	marker_file = fopen(marker_path, "r");
+	if (marker_file)
+	{
+		if (fgets(interrupted_name, sizeof(interrupted_name), marker_file))
+		{
+			interrupted_name[strcspn(interrupted_name, "\n")] = 0;
+			file_name = strrchr(interrupted_name, '/'); // markers of older versions hold the whole path
+			file_name = file_name ? file_name + 1 : interrupted_name;
+			if (snprintf(interrupted_path, sizeof(interrupted_path), "%s/%s", options.records_directory, file_name) < (int)sizeof(interrupted_path))
+				RecoverRecordFile(interrupted_path);
+			else printf("ERROR: Path of the interrupted result file %s is too long.\n", file_name);
+		}
+		fclose(marker_file);
+	}
+
+	GetResultFilePath(tm, store->path);
+	printf("Creating a result file in: %s\n", store->path);
+	marker_file = fopen(marker_path, "w");
+	if (marker_file)
+	{
+		file_name = strrchr(store->path, '/');
+		fprintf(marker_file, "%s\n", file_name ? file_name + 1 : store->path);
+		fflush(marker_file);
+		fsync(fileno(marker_file));
+		fclose(marker_file);
+	}
+	store->file = fopen(store->path, "a+");
+	if (store->file == NULL)
+	{
+		printf("ERROR: Could not create the result file: %s\n", store->path);
+		return -1;
+	}
+	return AppendRecord(store, RECORD_HEADER, strlen(RECORD_HEADER));
+}
+
+int CloseRecordStore(RECORD_STORE * store)
+{
+	char marker_path[MAX_FILE_PATH_LENGTH];
+	int status = CloseRecordBlock(store);
+
+	status |= fsync(fileno(store->file));
+	status |= fclose(store->file);
+	store->file = NULL;
+	if (!status)
+	{
+		snprintf(marker_path, sizeof(marker_path), "%s/%s", options.records_directory, RECORDS_OPEN_MARKER);
+		unlink(marker_path);
+	}
+	return status;
+}
+
+int FormatRecordLine(char record_line[], double record_time, SHTW1_SENSOR * sensor)
+{
+	return snprintf(record_line, MAX_RECORD_LINE_LENGTH, RECORD_LINE_FORMAT, record_time, sensor->name, sensor->temperature, sensor->humidity, sensor->dew_point);
+}
+
+int WriteResultRecords(RECORD_STORE * store, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// one record line per bound sensor, records of all sensors are interleaved in the result file
+	// every record carries the time of its own sample, not the time of the sweep
+	// records are flushed every sweep for the plots, but synced only when their block is sealed
+	int records_number = 0;
+	int flush_status = 0;
+	int record_line_length = 0;
+	uint64_t flush_start;
+	char record_line[MAX_RECORD_LINE_LENGTH];
+
+	PROBE1(record_write_entry, number_of_sensors);
+	while (number_of_sensors)
+	{
+		number_of_sensors--;
+		if (!sensors_table[number_of_sensors].fresh || !(sensors_table[number_of_sensors].sinks & SINK_RECORDS)) continue;
+		sensors_table[number_of_sensors].fresh = 0;
+		record_line_length = FormatRecordLine(record_line, GetRecordTime(sensors_table[number_of_sensors].sample_time), &sensors_table[number_of_sensors]);
+		PROBE2(record_line, sensors_table[number_of_sensors].stick_serial_number, record_line_length);
+		if (record_line_length < MAX_RECORD_LINE_LENGTH) AppendRecord(store, record_line, record_line_length);
+		else
+		{
+			char long_record_line[record_line_length + 1]; // long sensor name
+			snprintf(long_record_line, sizeof(long_record_line), RECORD_LINE_FORMAT, GetRecordTime(sensors_table[number_of_sensors].sample_time), sensors_table[number_of_sensors].name,
+				sensors_table[number_of_sensors].temperature, sensors_table[number_of_sensors].humidity, sensors_table[number_of_sensors].dew_point);
+			AppendRecord(store, long_record_line, record_line_length);
+		}
+		records_number++;
+	}
+	flush_start = TraceStart();
+	if (store->block_bytes && GetMonotonicTime() - store->block_start >= RECORD_SYNC_PERIOD_MS / 1000.0) flush_status = CloseRecordBlock(store);
+	else flush_status = fflush(store->file);
+	TraceEvent(TRACE_RECORD_FLUSH, flush_start, records_number);
+	PROBE2(record_write_return, records_number, flush_status);
+	return records_number;
+}
+
+void AddHistoryValues(HISTORY_BUCKET * bucket, const float values[])
+{
+	uint8_t channel;
+	for (channel = 0; channel < HISTORY_CHANNELS; channel++)
+	{
+		if (values[channel] == VIRTUAL_UNDEFINED) continue;
+		if (!bucket->counts[channel] || values[channel] < bucket->min[channel]) bucket->min[channel] = values[channel];
+		if (!bucket->counts[channel] || values[channel] > bucket->max[channel]) bucket->max[channel] = values[channel];
+		bucket->sum[channel] += values[channel];
+		bucket->counts[channel]++;
+	}
+}
+
+void MergeHistoryBucket(HISTORY_BUCKET * aggregate, const HISTORY_BUCKET * bucket)
+{
+	uint8_t channel;
+	for (channel = 0; channel < HISTORY_CHANNELS; channel++)
+	{
+		if (!bucket->counts[channel]) continue;
+		if (!aggregate->counts[channel] || bucket->min[channel] < aggregate->min[channel]) aggregate->min[channel] = bucket->min[channel];
+		if (!aggregate->counts[channel] || bucket->max[channel] > aggregate->max[channel]) aggregate->max[channel] = bucket->max[channel];
+		aggregate->sum[channel] += bucket->sum[channel];
+		aggregate->counts[channel] += bucket->counts[channel];
+	}
+}
+
+HISTORY_SAMPLE * GetHistorySample(SENSOR_HISTORY * history, uint32_t age)
+{
+	// age 0 = the newest raw sample
+	return &history->raw[(history->raw_current + HISTORY_RAW_SAMPLES - age) % HISTORY_RAW_SAMPLES];
+}
+
+HISTORY_BUCKET * GetHistoryBucket(SENSOR_HISTORY * history, uint8_t tier, uint32_t age)
+{
+	return &history->buckets[history_tiers[tier].offset + (history->bucket_current[tier] + history_tiers[tier].number_of_buckets - age) % history_tiers[tier].number_of_buckets];
+}
+
+int AllocateHistories(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the rings of the bound and the virtual sensors are allocated outside the sweep, before the memory is locked,
+	// a kept sensor keeps its ring, a sensor without one is measured but has no history
+	uint16_t sensors_iterator = 0;
+	int result = 0;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (sensors_table[sensors_iterator].history || (!sensors_table[sensors_iterator].usb_stick_handle && sensors_table[sensors_iterator].stick_serial_number)) continue;
+		if ((sensors_table[sensors_iterator].history = calloc(1, sizeof(SENSOR_HISTORY))) == NULL)
+		{
+			printf("ERROR: Could not allocate the history of sensor %s, it is measured without one.\n", sensors_table[sensors_iterator].name);
+			result = -1;
+		}
+	}
+	return result;
+}
+
+void AddToHistory(SHTW1_SENSOR * sensor)
+{
+	// the new sample goes into the raw ring and into the current bucket of every tier, a sample past the end of a bucket starts the next one
+	SENSOR_HISTORY * history = sensor->history;
+	HISTORY_SAMPLE * sample;
+	HISTORY_BUCKET * bucket;
+	double start;
+	uint8_t tier;
+
+	if (history == NULL) return;
+
+	if (history->raw_count) history->raw_current = (history->raw_current + 1) % HISTORY_RAW_SAMPLES;
+	if (history->raw_count < HISTORY_RAW_SAMPLES) history->raw_count++;
+	sample = &history->raw[history->raw_current];
+	sample->time = sensor->sample_time;
+	sample->values[0] = sensor->temperature;
+	sample->values[1] = sensor->humidity;
+	sample->values[2] = sensor->dew_point;
+
+	for (tier = 0; tier < HISTORY_TIERS; tier++)
+	{
+		start = floor(sample->time / history_tiers[tier].bucket_seconds) * history_tiers[tier].bucket_seconds;
+		bucket = GetHistoryBucket(history, tier, 0);
+		if (!history->bucket_count[tier] || bucket->start != start)
+		{
+			if (history->bucket_count[tier]) history->bucket_current[tier] = (history->bucket_current[tier] + 1) % history_tiers[tier].number_of_buckets;
+			if (history->bucket_count[tier] < history_tiers[tier].number_of_buckets) history->bucket_count[tier]++;
+			bucket = GetHistoryBucket(history, tier, 0);
+			memset(bucket, 0x00, sizeof(HISTORY_BUCKET));
+			bucket->start = start;
+		}
+		AddHistoryValues(bucket, sample->values);
+	}
+}
+
+int SelectHistoryTier(SENSOR_HISTORY * history, double from)
+{
+	// the finest level still reaching back to from: -1 = raw samples, then the tiers, the coarsest one when none reaches that far
+	uint8_t tier;
+	if (history->raw_count < HISTORY_RAW_SAMPLES || GetHistorySample(history, history->raw_count - 1)->time <= from) return -1;
+	for (tier = 0; tier < HISTORY_TIERS - 1; tier++)
+		if (history->bucket_count[tier] < history_tiers[tier].number_of_buckets || GetHistoryBucket(history, tier, history->bucket_count[tier] - 1)->start <= from) break;
+	return tier;
+}
+
+int IsHistoryAfter(SENSOR_HISTORY * history, int tier, uint32_t age, double from)
+{
+	// the raw sample or the bucket of the age reaches from, the rings are ordered by time so older ones do not
+	if (tier < 0) return GetHistorySample(history, age)->time >= from;
+	return GetHistoryBucket(history, tier, age)->start + history_tiers[tier].bucket_seconds > from;
+}
+
+// Query API of the history, times are CLOCK_MONOTONIC like sample_time, GetRecordTime converts them to the result file scale.
+
+uint32_t QueryHistoryLast(SHTW1_SENSOR * sensor, uint32_t count, HISTORY_SAMPLE samples[])
+{
+	// the last count raw samples, oldest first, returns the number of samples copied
+	uint32_t sample;
+	if (sensor->history == NULL) return 0;
+	if (count > sensor->history->raw_count) count = sensor->history->raw_count;
+	for (sample = 0; sample < count; sample++) samples[sample] = * GetHistorySample(sensor->history, count - 1 - sample);
+	return count;
+}
+
+uint32_t QueryHistoryRange(SHTW1_SENSOR * sensor, double from, double to, HISTORY_SAMPLE samples[], uint32_t max_samples)
+{
+	// samples from <= time < to, oldest first, from the finest level reaching back to from: raw samples, or bucket means at the bucket start
+	SENSOR_HISTORY * history = sensor->history;
+	HISTORY_SAMPLE * sample;
+	HISTORY_BUCKET * bucket;
+	uint32_t age = 0, number = 0, count = 0;
+	uint8_t channel;
+	int tier;
+
+	if (history == NULL) return 0;
+	tier = SelectHistoryTier(history, from);
+	number = (tier < 0) ? history->raw_count : history->bucket_count[tier];
+	while (age < number && IsHistoryAfter(history, tier, age, from)) age++;
+	while (age-- > 0 && count < max_samples)
+	{
+		if (tier < 0)
+		{
+			sample = GetHistorySample(history, age);
+			if (sample->time < to) samples[count++] = * sample;
+			continue;
+		}
+		bucket = GetHistoryBucket(history, tier, age);
+		if (bucket->start >= to) continue;
+		samples[count].time = bucket->start;
+		for (channel = 0; channel < HISTORY_CHANNELS; channel++)
+			samples[count].values[channel] = bucket->counts[channel] ? bucket->sum[channel] / bucket->counts[channel] : VIRTUAL_UNDEFINED;
+		count++;
+	}
+	return count;
+}
+
+int QueryHistoryAggregate(SHTW1_SENSOR * sensor, double from, double to, HISTORY_BUCKET * aggregate)
+{
+	// minimum, maximum, sum and count of every channel from <= time < to, a tier adds its whole buckets overlapping the range,
+	// returns -1 when there is no sample in the range
+	SENSOR_HISTORY * history = sensor->history;
+	HISTORY_SAMPLE * sample;
+	HISTORY_BUCKET * bucket;
+	uint32_t age = 0, number = 0;
+	int tier;
+
+	memset(aggregate, 0x00, sizeof(HISTORY_BUCKET));
+	aggregate->start = from;
+	if (history == NULL) return -1;
+	tier = SelectHistoryTier(history, from);
+	number = (tier < 0) ? history->raw_count : history->bucket_count[tier];
+	for (age = 0; age < number && IsHistoryAfter(history, tier, age, from); age++)
+	{
+		if (tier < 0)
+		{
+			sample = GetHistorySample(history, age);
+			if (sample->time < to) AddHistoryValues(aggregate, sample->values);
+			continue;
+		}
+		bucket = GetHistoryBucket(history, tier, age);
+		if (bucket->start < to) MergeHistoryBucket(aggregate, bucket);
+	}
+	return (aggregate->counts[0] || aggregate->counts[1] || aggregate->counts[2]) ? 0 : -1;
+}
+
+int IsPlottedSensor(SHTW1_SENSOR * sensor)
+{
+	return (sensor->usb_stick_handle || !sensor->stick_serial_number) && (sensor->sinks & SINK_PLOT);
+}
+
+void PlotSensorsColumn(FILE * gnuplot, char * file_path_string, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors, uint8_t column)
+{
+	// one line per bound sensor over the whole result file, only the sensors with the records sink are in it
+	uint16_t sensors_iterator = 0;
+	int first_line = 1;
+
+	fprintf(gnuplot, "plot ");
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!IsPlottedSensor(&sensors_table[sensors_iterator]) || !(sensors_table[sensors_iterator].sinks & SINK_RECORDS)) continue;
+		if (!first_line) fprintf(gnuplot, ", ");
+		fprintf(gnuplot, "'<awk ''$2==\"%s\"'' \"%s\"'", sensors_table[sensors_iterator].name, file_path_string); // exact name column, grep -w would match s1 in s1-b
+		fprintf(gnuplot, " using 1:%u title '%s' with lines", column, sensors_table[sensors_iterator].name);
+		first_line = 0;
+	}
+	fprintf(gnuplot, "\n");
+}
+
+void PlotSensorsHistory(FILE * gnuplot, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors, uint8_t channel)
+{
+	// the last NUMBER_OF_PLOT_POINTS samples of every bound sensor from its history, sent to gnuplot as inline data
+	// ('-', every block ended with 'e'), datablocks would need gnuplot 5.0
+	HISTORY_SAMPLE samples[NUMBER_OF_PLOT_POINTS];
+	uint32_t number_of_samples, sample;
+	uint16_t sensors_iterator = 0;
+	int first_line = 1;
+
+	fprintf(gnuplot, "plot ");
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!IsPlottedSensor(&sensors_table[sensors_iterator])) continue;
+		if (!first_line) fprintf(gnuplot, ", ");
+		fprintf(gnuplot, "'-' using 1:2 title '%s' with lines", sensors_table[sensors_iterator].name);
+		first_line = 0;
+	}
+	fprintf(gnuplot, "\n");
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!IsPlottedSensor(&sensors_table[sensors_iterator])) continue;
+		number_of_samples = QueryHistoryLast(&sensors_table[sensors_iterator], NUMBER_OF_PLOT_POINTS, samples);
+		for (sample = 0; sample < number_of_samples; sample++)
+			if (samples[sample].values[channel] != VIRTUAL_UNDEFINED) fprintf(gnuplot, "%0.3f %0.2f\n", GetRecordTime(samples[sample].time), samples[sample].values[channel]);
+		fprintf(gnuplot, "e\n");
+	}
+}
+
+void PrintResultPlots(struct tm tm, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	char file_path_string[MAX_FILE_PATH_LENGTH];	
+	GetResultFilePath(tm, file_path_string);
+
+	FILE *gnuplot= popen(options.plot_command, "w");
+	
+	fprintf(gnuplot, "set terminal x11 size 800,800\n");
+	fprintf(gnuplot, "set title 'Measurement plots of all measured points.'\n");
+	fprintf(gnuplot, "set multiplot layout 3,1 rowsfirst\n");
+
+	fprintf(gnuplot, "set title 'Temperature plot.'\n");				
+	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
+	fprintf(gnuplot, "set ylabel 'Temperature [*C]' rotate\n");
+	PlotSensorsColumn(gnuplot, file_path_string, sensors_table, number_of_sensors, 3);
+	
+	fprintf(gnuplot, "set title 'Relative Humidity plot.'\n");
+	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
+	fprintf(gnuplot, "set ylabel 'RH[%]' rotate\n");
+	PlotSensorsColumn(gnuplot, file_path_string, sensors_table, number_of_sensors, 4);
+
+	fprintf(gnuplot, "set title 'Dew Point plot.'\n");
+	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
+	fprintf(gnuplot, "set ylabel 'Dew_Point[*C]' rotate\n");
+	PlotSensorsColumn(gnuplot, file_path_string, sensors_table, number_of_sensors, 5);
+
+	fprintf(gnuplot, "unset multiplot\n");	
+	fflush(gnuplot);
+}
+
+void UpdatePlots(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the last NUMBER_OF_PLOT_POINTS samples of every plotted sensor are copied for the plot writer, formatting and the pipe writes
+	// stay off the sweep; the update is dropped while the writer is still busy with the previous frame
+	uint16_t sensors_iterator = 0, line = 0;
+	int busy = 0;
+
+	pthread_mutex_lock(&plot_writer.mutex);
+	busy = plot_writer.busy;
+	if (busy) plot_writer.skipped_frames++;
+	pthread_mutex_unlock(&plot_writer.mutex);
+	if (busy) return;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!IsPlottedSensor(&sensors_table[sensors_iterator])) continue;
+		snprintf(plot_writer.titles[line], PLOT_TITLE_LENGTH, "%s", sensors_table[sensors_iterator].name); // the names are freed by a reload
+		plot_writer.number_of_samples[line] = QueryHistoryLast(&sensors_table[sensors_iterator], NUMBER_OF_PLOT_POINTS, plot_writer.samples[line]);
+		line++;
+	}
+	plot_writer.number_of_lines = line;
+
+	pthread_mutex_lock(&plot_writer.mutex);
+	plot_writer.busy = 1;
+	pthread_cond_signal(&plot_writer.start);
+	pthread_mutex_unlock(&plot_writer.mutex);
+}
+
+void FormatPlotFrame(FILE * frame, uint8_t plot)
+{
+	// commands of one on-line plot for the copied frame, the channel of the history is the plot number;
+	// the X range is set from the samples, a replot would need the inline data again
+	uint16_t line = 0;
+	uint32_t sample = 0;
+	double first_time = 0.0, last_time = 0.0;
+	int timed = 0;
+
+	for (line = 0; line < plot_writer.number_of_lines; line++)
+	{
+		if (!plot_writer.number_of_samples[line]) continue;
+		if (!timed || plot_writer.samples[line][0].time < first_time) first_time = plot_writer.samples[line][0].time;
+		if (!timed || plot_writer.samples[line][plot_writer.number_of_samples[line] - 1].time > last_time) last_time = plot_writer.samples[line][plot_writer.number_of_samples[line] - 1].time;
+		timed = 1;
+	}
+
+	fprintf(frame, "set terminal x11 size 800,300\n");
+	fprintf(frame, "set title '%s'\n", plot_titles[plot]);
+	fprintf(frame, "set xlabel 'Time[s]'\n");
+	fprintf(frame, "set ylabel '%s' rotate\n", plot_labels[plot]);
+	fprintf(frame, "set yrange [%s]\n", plot_ranges[plot]);
+	if (timed && last_time > first_time) fprintf(frame, "set xrange [%0.3f:%0.3f]\n", GetRecordTime(first_time), GetRecordTime(last_time));
+	else fprintf(frame, "set xrange [*:*]\n");
+
+	fprintf(frame, "plot ");
+	for (line = 0; line < plot_writer.number_of_lines; line++) fprintf(frame, "%s'-' using 1:2 title '%s' with lines", line ? ", " : "", plot_writer.titles[line]);
+	fprintf(frame, "\n");
+	for (line = 0; line < plot_writer.number_of_lines; line++)
+	{
+		for (sample = 0; sample < plot_writer.number_of_samples[line]; sample++)
+			if (plot_writer.samples[line][sample].values[plot] != VIRTUAL_UNDEFINED)
+				fprintf(frame, "%0.3f %0.2f\n", GetRecordTime(plot_writer.samples[line][sample].time), plot_writer.samples[line][sample].values[plot]);
+		fprintf(frame, "e\n");
+	}
+}
+
+int WritePlotFrame(int descriptor, const char * frame, size_t length)
+{
+	// the pipe is non-blocking, so a plot process that stopped reading holds the writer at most until the shutdown deadline
+	struct pollfd pipe_descriptor = { .fd = descriptor, .events = POLLOUT };
+	ssize_t written = 0;
+
+	while (length)
+	{
+		written = write(descriptor, frame, length);
+		if (written > 0)
+		{
+			frame += written;
+			length -= (size_t)written;
+			continue;
+		}
+		if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+		if (!plot_writer.running && GetMonotonicTime() >= plot_writer.deadline) return -1;
+		poll(&pipe_descriptor, 1, SHUTDOWN_POLL_US / 1000);
+	}
+	return 0;
+}
+
+void * PlotWriterThread(void * dummy)
+{
+	char * frame = NULL;
+	size_t frame_length = 0;
+	FILE * frame_stream = NULL;
+	uint64_t frame_start;
+	uint8_t plot = 0;
+	int write_status = 0;
+	(void)dummy;
+
+	SetTraceThreadName("plot writer");
+	pthread_mutex_lock(&plot_writer.mutex);
+	while (1)
+	{
+		while (plot_writer.running && !plot_writer.busy) pthread_cond_wait(&plot_writer.start, &plot_writer.mutex);
+		if (!plot_writer.busy) break; // stopped, a copied frame is still written
+		pthread_mutex_unlock(&plot_writer.mutex);
+
+		frame_start = TraceStart();
+		PROBE1(plot_update_entry, plot_writer.number_of_lines);
+		write_status = 0;
+		for (plot = 0; plot < NUMBER_OF_PLOTS; plot++)
+		{
+			if ((frame_stream = open_memstream(&frame, &frame_length)) == NULL)
+			{
+				write_status = -1;
+				continue;
+			}
+			FormatPlotFrame(frame_stream, plot);
+			fclose(frame_stream);
+			write_status |= WritePlotFrame(plot_writer.descriptors[plot], frame, frame_length);
+			free(frame);
+			frame = NULL;
+		}
+		TraceEvent(TRACE_PLOT_FRAME, frame_start, plot_writer.number_of_lines);
+		PROBE1(plot_update_return, write_status);
+
+		pthread_mutex_lock(&plot_writer.mutex);
+		plot_writer.busy = 0;
+	}
+	pthread_mutex_unlock(&plot_writer.mutex);
+	return NULL;
+}
+
+int StartPlotWriter(PLOT_PROCESS plots[])
+{
+	// at the normal priority on any CPU, like the plot processes it feeds
+	pthread_attr_t attributes;
+	uint8_t plot = 0;
+	int result = 0;
+
+	for (plot = 0; plot < NUMBER_OF_PLOTS; plot++)
+	{
+		plot_writer.descriptors[plot] = fileno(plots[plot].pipe);
+		fcntl(plot_writer.descriptors[plot], F_SETFL, O_NONBLOCK);
+	}
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, PLOT_WRITER_STACK_SIZE);
+	plot_writer.running = 1;
+	result = pthread_create(&plot_writer.thread, &attributes, PlotWriterThread, NULL);
+	pthread_attr_destroy(&attributes);
+	if (result)
+	{
+		plot_writer.running = 0;
+		printf("ERROR: Could not start the plot writer: %s, the on-line plots are not updated.\n", strerror(result));
+		return -1;
+	}
+	return 0;
+}
+
+void StopPlotWriter(double deadline)
+{
+	// a frame already copied is still written until the deadline (CLOCK_MONOTONIC)
+	if (!plot_writer.running) return;
+	pthread_mutex_lock(&plot_writer.mutex);
+	plot_writer.deadline = deadline;
+	plot_writer.running = 0;
+	pthread_cond_signal(&plot_writer.start);
+	pthread_mutex_unlock(&plot_writer.mutex);
+	pthread_join(plot_writer.thread, NULL);
+}
+
+int OpenPlotProcess(PLOT_PROCESS * plot, const char * command)
+{
+	// popen(command, "w") keeping the pid, a plot process that does not quit can be terminated at the shutdown deadline
+	int descriptors[2];
+
+	plot->pipe = NULL;
+	plot->pid = -1;
+	if (pipe(descriptors)) return -1;
+	plot->pid = fork();
+	if (plot->pid == 0)
+	{
+		setpgid(0, 0); // the plot command and its children are killed together
+		dup2(descriptors[0], STDIN_FILENO);
+		close(descriptors[0]);
+		close(descriptors[1]);
+		execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+		_exit(127);
+	}
+	close(descriptors[0]);
+	if (plot->pid < 0)
+	{
+		close(descriptors[1]);
+		return -1;
+	}
+	fcntl(descriptors[1], F_SETFD, FD_CLOEXEC); // the next plot processes must not keep this pipe open
+	plot->pipe = fdopen(descriptors[1], "w");
+	return plot->pipe ? 0 : -1;
+}
+
+int ClosePlotProcess(PLOT_PROCESS * plot, double deadline)
+{
+	// asks the plot process to quit and waits until the deadline (CLOCK_MONOTONIC), returns -1 when it had to be killed
+	int status = 0;
+	pid_t result = 0;
+
+	if (plot->pid <= 0) return 0;
+	if (plot->pipe)
+	{
+		fcntl(fileno(plot->pipe), F_SETFL, O_NONBLOCK); // commands a stuck plot process does not read are dropped
+		fprintf(plot->pipe, "quit\n");
+		fclose(plot->pipe);
+		plot->pipe = NULL;
+	}
+	while ((result = waitpid(plot->pid, &status, WNOHANG)) == 0 && GetMonotonicTime() < deadline) usleep(SHUTDOWN_POLL_US);
+	if (result == 0)
+	{
+		kill(-plot->pid, SIGKILL);
+		waitpid(plot->pid, &status, 0);
+	}
+	plot->pid = -1;
+	return result == 0 ? -1 : 0;
+}
+
+uint32_t HashSerialNumber(uint32_t serial_number)
+{
+	// integer mix, consecutive serial numbers of one production batch spread over the whole index
+	serial_number ^= serial_number >> 16;
+	serial_number *= 0x7FEB352D;
+	serial_number ^= serial_number >> 15;
+	serial_number *= 0x846CA68B;
+	serial_number ^= serial_number >> 16;
+	return serial_number;
+}
+
+uint32_t HashSensorName(const char * name)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	while (* name) hash = (hash ^ (uint8_t)* name++) * 16777619u;
+	return hash;
+}
+
+int32_t FindStickSensors(SHTW1_SENSOR sensors_table[], uint32_t stick_serial_number)
+{
+	// first sensor of the stick in the table, the others follow through next_on_stick, -1 = stick not configured
+	uint32_t slot = HashSerialNumber(stick_serial_number) & (SENSOR_INDEX_SIZE - 1);
+	while (sensor_index[slot] >= 0)
+	{
+		if (sensors_table[sensor_index[slot]].stick_serial_number == stick_serial_number) return sensor_index[slot];
+		slot = (slot + 1) & (SENSOR_INDEX_SIZE - 1);
+	}
+	return -1;
+}
+
+int32_t AddToSensorIndex(SHTW1_SENSOR sensors_table[], uint16_t sensor)
+{
+	// links the sensor into the index (linear probing), returns the sensor already using the same stick and I2C address or -1
+	uint32_t slot = HashSerialNumber(sensors_table[sensor].stick_serial_number) & (SENSOR_INDEX_SIZE - 1);
+	int32_t same_stick;
+
+	if (!sensors_table[sensor].stick_serial_number) return -1; // virtual sensor
+
+	while (sensor_index[slot] >= 0 && sensors_table[sensor_index[slot]].stick_serial_number != sensors_table[sensor].stick_serial_number)
+		slot = (slot + 1) & (SENSOR_INDEX_SIZE - 1);
+
+	for (same_stick = sensor_index[slot]; same_stick >= 0; same_stick = sensors_table[same_stick].next_on_stick)
+		if (sensors_table[same_stick].i2c_address == sensors_table[sensor].i2c_address) return same_stick;
+
+	sensors_table[sensor].next_on_stick = sensor_index[slot];
+	sensor_index[slot] = sensor;
+	return -1;
+}
+
+int BindSensor(SHTW1_SENSOR * sensor, IOWKIT_HANDLE handle)
+{
+	// initializes the part with every sensor driver and binds it with the USB stick when one of them answers
+	uint8_t driver;
+
+	for (driver = 0; driver < sizeof(sensor_drivers) / sizeof(sensor_drivers[0]); driver++)
+	{
+		sensor->driver = driver;
+		if (sensor_drivers[driver].initialize(handle, sensor) == 0) break;
+	}
+	if (driver == sizeof(sensor_drivers) / sizeof(sensor_drivers[0]))
+	{
+		printf("Could not connect to any known sensor at I2C address 0x%02X with this device, probably sensor is missing!\n", sensor->i2c_address);
+		strncpy(sensor->info, "ERROR: Physical Sensor not found!\0", MAX_SENSOR_INFO_LENGTH);
+		return -1;
+	}
+
+	printf("Found %s sensor at I2C address 0x%02X connected to this device!\n", sensor_drivers[driver].name, sensor->i2c_address);
+	if (!(sensor_drivers[driver].readouts & (1 << sensor->readout))) printf("ERROR: %s has no %s readout, it is polled.\n", sensor_drivers[driver].name, readout_names[sensor->readout]);
+	sensor->usb_stick_handle = handle;
+	strncpy(sensor->info, "OK: USB Stick and Physical Sensor found!\0", MAX_SENSOR_INFO_LENGTH);
+	printf("Bound USB STICK with a Sensor!\n");
+	return 0;
+}
+
+int CompareDoubles(const void * a, const void * b)
+{
+	double difference = *(const double *)a - *(const double *)b;
+	return (difference > 0) - (difference < 0);
+}
+
+void CalibrateSticks(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the USB round trip of a stick is measured once, by timing identify transactions of its first bound sensor, a sensor in the
+	// periodic mode takes only fetches and is not used; the bound sensors of every stick are numbered for the sweep schedule
+	double round_trips[STICK_PROBE_ROUNDS];
+	double probe_start, round_trip, min_round_trip = 0.0, max_round_trip = 0.0, round_trip_sum = 0.0;
+	uint32_t probed_sticks = 0, slowest_stick = 0;
+	uint16_t sensors_iterator = 0, rank = 0;
+	int32_t sensor = -1, probe = -1;
+	uint8_t round = 0, valid_rounds = 0;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!sensors_table[sensors_iterator].stick_serial_number || FindStickSensors(sensors_table, sensors_table[sensors_iterator].stick_serial_number) != sensors_iterator) continue;
+
+		round_trip = 0.0;
+		probe = -1;
+		for (sensor = sensors_iterator; sensor >= 0; sensor = sensors_table[sensor].next_on_stick)
+		{
+			if (sensors_table[sensor].usb_round_trip > round_trip) round_trip = sensors_table[sensor].usb_round_trip; // kept over a reload
+			if (probe < 0 && sensors_table[sensor].usb_stick_handle && sensors_table[sensor].readout != READOUT_PERIODIC) probe = sensor;
+		}
+		if (round_trip == 0.0 && probe >= 0)
+		{
+			// an identify transaction is a write report and a read report, each with its reply
+			for (round = 0, valid_rounds = 0; round < STICK_PROBE_ROUNDS; round++)
+			{
+				probe_start = GetMonotonicTime();
+				if (sensor_drivers[sensors_table[probe].driver].identify(sensors_table[probe].usb_stick_handle, sensors_table[probe].stick_serial_number,
+					sensors_table[probe].i2c_address)) continue;
+				round_trips[valid_rounds++] = (GetMonotonicTime() - probe_start) / 2;
+			}
+			if (valid_rounds)
+			{
+				qsort(round_trips, valid_rounds, sizeof(double), CompareDoubles);
+				round_trip = round_trips[valid_rounds / 2];
+				if (!probed_sticks || round_trip < min_round_trip) min_round_trip = round_trip;
+				if (round_trip > max_round_trip)
+				{
+					max_round_trip = round_trip;
+					slowest_stick = sensors_table[probe].stick_serial_number;
+				}
+				round_trip_sum += round_trip;
+				probed_sticks++;
+			}
+		}
+
+		for (sensor = sensors_iterator, rank = 0; sensor >= 0; sensor = sensors_table[sensor].next_on_stick)
+		{
+			sensors_table[sensor].usb_round_trip = round_trip;
+			if (sensors_table[sensor].usb_stick_handle) sensors_table[sensor].stick_rank = rank++;
+		}
+	}
+	if (probed_sticks) printf("USB round trip of %u sticks: min %.3f, mean %.3f, max %.3f[ms] (S/N (dec) %u)\n", probed_sticks, min_round_trip * 1000,
+		round_trip_sum / probed_sticks * 1000, max_round_trip * 1000, slowest_stick);
+}
+
+int CompareSweepSlots(const void * a, const void * b)
+{
+	// trigger order: the n-th sensors of all sticks before the (n+1)-th ones, so consecutive transactions go to different sticks,
+	// slower sticks first, their long transactions overlap the conversions of the others; ties in the reverse table order
+	const SWEEP_SLOT * first = (const SWEEP_SLOT *)a;
+	const SWEEP_SLOT * second = (const SWEEP_SLOT *)b;
+
+	if (first->stick_rank != second->stick_rank) return (first->stick_rank > second->stick_rank) - (first->stick_rank < second->stick_rank);
+	if (first->usb_round_trip != second->usb_round_trip) return (first->usb_round_trip < second->usb_round_trip) - (first->usb_round_trip > second->usb_round_trip);
+	return (first->sensor < second->sensor) - (first->sensor > second->sensor);
+}
+
+int CompareSweepSlotsReady(const void * a, const void * b)
+{
+	// fetch order: by the end of the conversion, in the trigger order when the conversions end together
+	const SWEEP_SLOT * first = (const SWEEP_SLOT *)a;
+	const SWEEP_SLOT * second = (const SWEEP_SLOT *)b;
+
+	if (first->ready != second->ready) return (first->ready > second->ready) - (first->ready < second->ready);
+	return (first->order > second->order) - (first->order < second->order);
+}
+
+int InitializeSticksAndSensors(IOWKIT_HANDLE handles_table[], uint32_t stick_serial_numbers[], unsigned long number_of_devices, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	int32_t sensors_iterator = 0;
+	uint32_t stick_serial_number = 0;
+	uint16_t clock_khz = 0;
+	const I2C_CLOCK_SETTING * clock = NULL;
+
+	printf("\nThere could be maximum of %u io-warrior devices connected to this PC.\n", IOWKIT_MAX_DEVICES);
+	printf("There are %u io-warrior USB Stick devices connected to this PC.\n", number_of_devices);	
+	
+	while (number_of_devices)
+	{
+		number_of_devices--;		
+		printf("\n-- USB Stick Device %u ------------------------------------\n", number_of_devices);
+		stick_serial_number = GetUsbStickSerialNumber(handles_table[number_of_devices]);
+		stick_serial_numbers[number_of_devices] = stick_serial_number;
+		printf("S/N (dec) of the io-warrior device at: %u\n", stick_serial_number);	
+		IowKitSetTimeout(handles_table[number_of_devices], I2C_TIMEOUT_MS);
+
+		sensors_iterator = FindStickSensors(sensors_table, stick_serial_number);
+		clock_khz = (sensors_iterator >= 0) ? sensors_table[sensors_iterator].i2c_clock_khz : 0;
+		clock = FindI2cClock(IowKitGetProductId(handles_table[number_of_devices]), clock_khz);
+		if (clock == NULL && clock_khz)
+		{
+			printf("ERROR: I2C clock %u[kHz] is not supported by this device (product ID 0x%04X), the default clock is used.\n", clock_khz,
+				(unsigned int)IowKitGetProductId(handles_table[number_of_devices]));
+			clock = FindI2cClock(IowKitGetProductId(handles_table[number_of_devices]), 0);
+		}
+		if (clock) printf("I2C clock: %u[kHz]\n", clock->clock_khz);
+		EnableI2c(handles_table[number_of_devices], clock ? clock->clock_khz : 0);
+
+		if (sensors_iterator < 0) printf("No sensor in the configuration uses this device.\n");
+		for (; sensors_iterator >= 0; sensors_iterator = sensors_table[sensors_iterator].next_on_stick) BindSensor(&sensors_table[sensors_iterator], handles_table[number_of_devices]);
+		printf("----------------------------------------------------------\n\n");		
+	}	
+	CalibrateSticks(sensors_table, number_of_sensors);
+	AllocateHistories(sensors_table, number_of_sensors);
+	sweep_workers.layout_changed = 1;
+}
+
+int CheckSensorsPresence(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	uint8_t missing_sensors_number = 0;
+	while(number_of_sensors)
+	{
+		number_of_sensors--;
+		
+		if (!sensors_table[number_of_sensors].usb_stick_handle && sensors_table[number_of_sensors].stick_serial_number)
+		{
+			printf("ERROR: Have not found sensor: %s with USB STICK S/N (dec) %u !\n",sensors_table[number_of_sensors].name, sensors_table[number_of_sensors].stick_serial_number);
+			missing_sensors_number++;
+		}
+	}
+	if (missing_sensors_number) return -missing_sensors_number;
+	return 0;
+}
+
+uint8_t GetSensorErrorRate(SENSOR_HEALTH * health)
+{
+	// percent of failed transactions in the window
+	if (!health->window_length) return 0;
+	return (uint8_t)(100 * (health->window_length - health->window_counters[HEALTH_OK]) / health->window_length);
+}
+
+uint8_t GetSensorHealthScore(SENSOR_HEALTH * health)
+{
+	// 100 = no errors in the window, 0 = every sample in the window lost
+	uint32_t penalty = 0;
+	uint8_t event = 0;
+	if (!health->window_length) return 100;
+	for (event = 0; event < NUMBER_OF_HEALTH_EVENTS; event++) penalty += health_event_weights[event] * health->window_counters[event];
+	return (uint8_t)(100 - 50 * penalty / health->window_length);
+}
+
+int RecoverSensor(SHTW1_SENSOR * sensor)
+{
+	// escalates from the current level until the driver initializes the part again
+	SENSOR_HEALTH * health = &sensor->health;
+	uint8_t action = health->escalation;
+	uint64_t trace_recovery_start;
+	double action_start, action_time, recovery_start = GetMonotonicTime();
+	int status = -1;
+	uint32_t stalls = usb_watchdog_slot->stalls;
+
+	printf("Sensor %s: %u%% of the last %u transactions failed, %u in a row\n", sensor->name, GetSensorErrorRate(health), health->window_length, health->consecutive_failures);
+	if (!health->recovery_start) health->recovery_start = recovery_start; // repeated recoveries count from the first one
+
+	for (; action < NUMBER_OF_RECOVERY_ACTIONS && status; action++)
+	{
+		trace_recovery_start = TraceStart();
+		action_start = GetMonotonicTime();
+		if (action == RECOVERY_BUS_REENABLE)
+		{
+			DisableI2c(sensor->usb_stick_handle);
+			EnableI2c(sensor->usb_stick_handle, sensor->i2c_clock_khz);
+		}
+		status = sensor_drivers[sensor->driver].initialize(sensor->usb_stick_handle, sensor);
+
+		action_time = MarkSweepPhase(PHASE_RECOVERY, action_start) - action_start;
+		TraceEvent(TRACE_RECOVERY, trace_recovery_start, sensor->stick_serial_number);
+		PROBE3(sensor_recovery, sensor->stick_serial_number, action, status);
+
+		health->recoveries[action]++;
+		health->action_time += action_time;
+		if (action_time > health->max_action_time) health->max_action_time = action_time;
+		printf("   %s: sensor %s after %.2f[ms]\n", recovery_action_names[action], status ? "did not answer" : "answered", action_time * 1000);
+	}
+	// a sensor failing again within a window starts from the stronger action
+	health->escalation = (action < NUMBER_OF_RECOVERY_ACTIONS) ? action : NUMBER_OF_RECOVERY_ACTIONS - 1;
+
+	// the window restarts, so the next decision is based on transactions after this recovery only
+	health->window_index = 0;
+	health->window_length = 0;
+	health->consecutive_failures = 0;
+	memset(health->window_counters, 0x00, sizeof(health->window_counters));
+
+	if (status)
+	{
+		health->failed_recoveries++;
+		printf("ERROR: Could not recover sensor: %s with USB STICK S/N (dec) %u !\n", sensor->name, sensor->stick_serial_number);
+		// the stick still stalls after the reset, only closing and opening the devices again is left
+		if (usb_watchdog_slot->stalls != stalls) usb_watchdog.reopen_requested = 1;
+		return -1;
+	}
+	__sync_fetch_and_add(&bench_statistics.number_of_recoveries, 1); // sweep workers recover their sensors at the same time
+	return 0;
+}
+
+void UpdateSensorHealth(SHTW1_SENSOR * sensor, enum HEALTH_EVENT event)
+{
+	// adds a transaction outcome to the sliding window and starts a recovery when the error rate crosses the threshold
+	SENSOR_HEALTH * health = &sensor->health;
+	double recovered_time;
+
+	if (health->window_length == HEALTH_WINDOW) health->window_counters[health->window[health->window_index]]--;
+	else health->window_length++;
+	health->window[health->window_index] = (uint8_t)event;
+	health->window_index = (health->window_index + 1) % HEALTH_WINDOW;
+	health->window_counters[event]++;
+	health->counters[event]++;
+
+	if (health->window_length == HEALTH_WINDOW) health->escalation = RECOVERY_SOFT_RESET; // a full window passed without a recovery
+
+	if (event == HEALTH_OK)
+	{
+		health->consecutive_failures = 0;
+		if (health->recovery_start)
+		{
+			recovered_time = GetMonotonicTime() - health->recovery_start;
+			health->recovered++;
+			health->recovered_time += recovered_time;
+			if (recovered_time > health->max_recovered_time) health->max_recovered_time = recovered_time;
+			health->recovery_start = 0;
+		}
+		return;
+	}
+
+	health->consecutive_failures++;
+	if (event == HEALTH_STALL)
+	{
+		// a cancelled transfer leaves the stick in an unknown state, the soft reset alone does not help
+		if (health->escalation < RECOVERY_BUS_REENABLE) health->escalation = RECOVERY_BUS_REENABLE;
+		RecoverSensor(sensor);
+		return;
+	}
+	if (health->consecutive_failures >= HEALTH_MAX_CONSECUTIVE_FAILURES ||
+		(health->window_length >= HEALTH_MIN_TRANSACTIONS && GetSensorErrorRate(health) >= HEALTH_RECOVERY_THRESHOLD)) RecoverSensor(sensor);
+}
+
+void PrintSensorsHealth(FILE * output, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// only sensors that ever failed are listed
+	SENSOR_HEALTH * health;
+	uint16_t healthy_sensors = 0;
+
+	fprintf(output, "\n-- Sensors health, last %u transactions ---------------------\n", HEALTH_WINDOW);
+	fprintf(output, "   %-20s %5s %5s %7s %5s %6s %5s %6s %9s %18s %21s\n", "sensor", "score", "nack", "timeout", "t_crc", "rh_crc", "stall", "resets", "reenables", "action tot/max[ms]", "recovered avg/max[ms]");
+	while (number_of_sensors)
+	{
+		number_of_sensors--;
+		health = &sensors_table[number_of_sensors].health;
+		if (!health->counters[HEALTH_NACK] && !health->counters[HEALTH_TIMEOUT] && !health->counters[HEALTH_T_CRC] && !health->counters[HEALTH_RH_CRC] &&
+			!health->counters[HEALTH_STALL])
+		{
+			healthy_sensors++;
+			continue;
+		}
+		fprintf(output, "   %-20s %5u %5u %7u %5u %6u %5u %6u %9u %10.2f/%7.2f %13.2f/%7.2f\n", sensors_table[number_of_sensors].name, GetSensorHealthScore(health),
+			health->window_counters[HEALTH_NACK], health->window_counters[HEALTH_TIMEOUT], health->window_counters[HEALTH_T_CRC], health->window_counters[HEALTH_RH_CRC],
+			health->window_counters[HEALTH_STALL],
+			health->recoveries[RECOVERY_SOFT_RESET], health->recoveries[RECOVERY_BUS_REENABLE],
+			health->action_time * 1000, health->max_action_time * 1000,
+			health->recovered ? health->recovered_time / health->recovered * 1000 : 0.0, health->max_recovered_time * 1000);
+	}
+	fprintf(output, "   %u sensors without errors\n", healthy_sensors);
+	if (usb_watchdog.stalls) fprintf(output, "   %u USB transfers stalled, longest %.0f[ms], %u re-opens of the sticks, avg/max %.2f/%.2f[ms]\n", usb_watchdog.stalls,
+		usb_watchdog.max_stall_time * 1000, usb_watchdog.reopens, usb_watchdog.reopens ? usb_watchdog.reopen_time / usb_watchdog.reopens * 1000 : 0.0,
+		usb_watchdog.max_reopen_time * 1000);
+}
+
+void UpdateSamplePeriod(SHTW1_SENSOR * sensor)
+{
+	// fast attack, slow decay: a transient switches to the fastest period at once, stable readings double the period
+	ADAPTIVE_SAMPLING * adaptive = &sensor->adaptive;
+	uint32_t period_ms = GetSamplePeriod(sensor);
+	double interval = sensor->sample_time - adaptive->sample_time;
+	float temperature_change = fabsf(sensor->temperature - adaptive->temperature);
+	float humidity_change = fabsf(sensor->humidity - adaptive->humidity);
+	float deviation;
+	int transient = 0;
+
+	if (adaptive->sample_time > 0 && interval > 0)
+	{
+		transient = (temperature_change > ADAPTIVE_T_NOISE && temperature_change / interval > ADAPTIVE_T_RATE) ||
+			(humidity_change > ADAPTIVE_RH_NOISE && humidity_change / interval > ADAPTIVE_RH_RATE);
+
+		deviation = sensor->temperature - adaptive->temperature_mean;
+		adaptive->temperature_mean += ADAPTIVE_WEIGHT * deviation;
+		adaptive->temperature_variance = (1 - ADAPTIVE_WEIGHT) * (adaptive->temperature_variance + ADAPTIVE_WEIGHT * deviation * deviation);
+		deviation = sensor->humidity - adaptive->humidity_mean;
+		adaptive->humidity_mean += ADAPTIVE_WEIGHT * deviation;
+		adaptive->humidity_variance = (1 - ADAPTIVE_WEIGHT) * (adaptive->humidity_variance + ADAPTIVE_WEIGHT * deviation * deviation);
+		transient |= adaptive->temperature_variance > ADAPTIVE_T_DEVIATION * ADAPTIVE_T_DEVIATION ||
+			adaptive->humidity_variance > ADAPTIVE_RH_DEVIATION * ADAPTIVE_RH_DEVIATION;
+	}
+	else
+	{
+		adaptive->temperature_mean = sensor->temperature;
+		adaptive->humidity_mean = sensor->humidity;
+		adaptive->temperature_variance = adaptive->humidity_variance = 0;
+	}
+	adaptive->temperature = sensor->temperature;
+	adaptive->humidity = sensor->humidity;
+	adaptive->sample_time = sensor->sample_time;
+
+	if (transient)
+	{
+		adaptive->stable_samples = 0;
+		if (period_ms != sensor->period_ms) adaptive->speedups++;
+		period_ms = sensor->period_ms;
+	}
+	else if (++adaptive->stable_samples >= ADAPTIVE_STABLE_SAMPLES)
+	{
+		adaptive->stable_samples = 0;
+		period_ms = period_ms < ADAPTIVE_MIN_STEP_MS / 2 ? ADAPTIVE_MIN_STEP_MS : period_ms * 2;
+		if (period_ms > sensor->max_period_ms) period_ms = sensor->max_period_ms;
+	}
+	if (period_ms != GetSamplePeriod(sensor)) adaptive->period_changed = 1;
+	adaptive->period_ms = period_ms;
+}
+
+int SweepSensors(SHTW1_SENSOR sensors_table[], const uint16_t sensors[], uint16_t number_of_sensors, SWEEP_SLOT slots[])
+{
+	// every due sensor is triggered first and fetched when its conversion ends, so the conversions overlap each other and the USB
+	// transactions of the other sensors: a sweep takes the transactions plus about one conversion instead of all the conversions;
+	// sensors lists the indexes of the swept sensors in the table, NULL = the first number_of_sensors of the table
+	SWEEP_SLOT * slot;
+	SHTW1_SENSOR * sensor;
+	uint16_t number_of_slots = 0, sensors_iterator = 0, sensor_index = 0;
+	float T, RH, DP;
+	uint32_t stick_serial_number;
+	uint64_t transaction_start;
+	int result = 0;
+	int write_result;
+	uint8_t decode_errors;
+	uint16_t temperature_raw, humidity_raw;
+	double phase_start, transaction_end, sample_age;
+	uint32_t sample_period_ms, conversion_time_us;
+	uint8_t channels;
+	const SENSOR_DRIVER * driver;
+	IOWKIT_SPECIAL_REPORT return_report;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		sensor_index = sensors ? sensors[sensors_iterator] : sensors_iterator;
+		sensor = &sensors_table[sensor_index];
+		if (!sensor->usb_stick_handle) continue;
+
+		// sensors with a longer sample period skip sweeps
+		sample_period_ms = GetSamplePeriod(sensor);
+		sample_age = GetMonotonicTime() - sensor->sample_time;
+		if (sample_period_ms && sensor->sample_time > 0 && sample_age < sample_period_ms / 1000.0)
+		{
+			if (sample_age >= sensor->period_ms / 1000.0) sensor->adaptive.saved_samples++;
+			continue;
+		}
+		slots[number_of_slots++] = (SWEEP_SLOT){ .sensor = sensor_index, .stick_rank = sensor->stick_rank, .usb_round_trip = sensor->usb_round_trip };
+	}
+	qsort(slots, number_of_slots, sizeof(SWEEP_SLOT), CompareSweepSlots);
+
+	// with polling the conversion ends before the fetch, with clock stretching the rest of it is hidden inside the USB read,
+	// in the periodic mode nothing is triggered, the driver only fetches the last result
+	for (slot = slots; slot < slots + number_of_slots; slot++)
+	{
+		sensor = &sensors_table[slot->sensor];
+		driver = &sensor_drivers[sensor->driver];
+		slot->order = (uint16_t)(slot - slots);
+		transaction_start = TraceStart();
+		phase_start = slot->trigger_begin = GetMonotonicTime();
+		if ((write_result = driver->trigger(sensor)) != 3)
+		{
+			MarkSweepPhase(PHASE_USB_WRITE, phase_start);
+			TraceEvent(TRACE_TRANSACTION, transaction_start, sensor->stick_serial_number);
+			printf("I2C operation ERROR while writing measure command!\n");
+			UpdateSensorHealth(sensor, write_result == -3 ? HEALTH_STALL : write_result == -2 ? HEALTH_TIMEOUT : HEALTH_NACK);
+			result = -1;
+			slot->ready = -1.0; // not fetched
+			continue;
+		}
+		conversion_time_us = driver->conversion_time_us(sensor);
+		slot->ready = MarkSweepPhase(PHASE_USB_WRITE, phase_start) + conversion_time_us / 1000000.0;
+		slot->conversion_end = conversion_time_us ? slot->ready : 0.0;
+		TraceEvent(TRACE_TRANSACTION, transaction_start, sensor->stick_serial_number);
+	}
+	qsort(slots, number_of_slots, sizeof(SWEEP_SLOT), CompareSweepSlotsReady);
+
+	for (slot = slots; slot < slots + number_of_slots; slot++)
+	{
+		if (slot->ready < 0) continue;
+		sensor = &sensors_table[slot->sensor];
+		driver = &sensor_drivers[sensor->driver];
+		stick_serial_number = sensor->stick_serial_number;
+		channels = sensor->channels;
+
+		// only the part of the conversion not spent in the transactions of the other sensors is waited out
+		phase_start = GetMonotonicTime();
+		if (slot->ready > phase_start) usleep((useconds_t)((slot->ready - phase_start) * 1000000));
+		phase_start = MarkSweepPhase(PHASE_CONVERSION_WAIT, phase_start);
+
+		transaction_start = TraceStart();
+		return_report = driver->fetch(sensor);
+		phase_start = transaction_end = MarkSweepPhase(PHASE_USB_READ, phase_start);
+		TraceEvent(TRACE_TRANSACTION, transaction_start, stick_serial_number);
+		if (return_report.Bytes[0] == I2C_REPORT_NO_DATA) continue; // sweep faster than the periodic measurements, not an error
+		if (return_report.Bytes[0] & 0x80) 
+		{
+			UpdateSensorHealth(sensor, return_report.Bytes[0] == I2C_REPORT_STALL ? HEALTH_STALL :
+				return_report.Bytes[0] == I2C_REPORT_TIMEOUT ? HEALTH_TIMEOUT : HEALTH_NACK);
+			result = -1;
+			continue;
+		}
+
+		// Check CRC for Temperature and Humidity data - 2 bytes each of the report.Bytes[], the driver knows their order
+		decode_errors = driver->decode(sensor, &return_report, &temperature_raw, &humidity_raw);
+		phase_start = MarkSweepPhase(PHASE_CRC, phase_start);
+
+		if (decode_errors & DECODE_T_CRC)
+		{
+		 	printf("Checksum ERROR for temperature measurement\n");
+			UpdateSensorHealth(sensor, HEALTH_T_CRC);
+			result = -2; // Temperature measurement is a priority in this code, without it humidity is not processed
+			continue;
+		}
+		if (decode_errors & DECODE_RH_CRC)
+		{			
+			printf("Checksum ERROR only for humidity measurement\n");
+			UpdateSensorHealth(sensor, HEALTH_RH_CRC);
+			result = -3;
+			continue;
+		}
+
+		T = RH = DP = 1000; // channels not read, dew point is not defined for zero humidity
+		if (channels != CHANNEL_RH) T = ConvertTemperature(temperature_raw) + sensor->temperature_offset;
+		if (channels != CHANNEL_T)
+		{
+			RH = ConvertHumidity(humidity_raw) + sensor->humidity_offset;
+			if (RH < 0.0) RH = 0.0;
+			if (RH > 100.0) RH = 100.0;
+		}
+		if (channels == CHANNELS_T_RH && RH > 0.0 && (sensor->derived_channels & DERIVED_DEW_POINT)) DP = CalculateDewPoint(T, RH);
+		MarkSweepPhase(PHASE_CONVERSION, phase_start);
+
+		sensor->temperature = T;
+		sensor->humidity = RH;
+		sensor->dew_point = DP;
+		sensor->fresh = 1;
+		// a polled sample was taken before the end of its conversion, however late it was fetched
+		AddSampleTiming(sensor, slot->trigger_begin, (slot->conversion_end > 0.0 && slot->conversion_end < transaction_end) ? slot->conversion_end : transaction_end);
+		AddToHistory(sensor);
+		if (sensor->max_period_ms) UpdateSamplePeriod(sensor);
+		UpdateSensorHealth(sensor, HEALTH_OK);
+	}
+	return result;
+}
+
+int ReadSysfsAttribute(const char * device, const char * attribute, char value[], size_t size)
+{
+	// first line of an attribute file of a USB device, without the newline
+	char path[MAX_FILE_PATH_LENGTH];
+	FILE * attribute_file;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", options.usb_sysfs_path, device, attribute);
+	if ((attribute_file = fopen(path, "r")) == NULL) return -1;
+	if (fgets(value, (int)size, attribute_file) == NULL) value[0] = '\0';
+	fclose(attribute_file);
+	value[strcspn(value, "\n")] = '\0';
+	return value[0] ? 0 : -1;
+}
+
+uint32_t MapStickTopology(STICK_TOPOLOGY sticks[], uint32_t number_of_sticks)
+{
+	// sysfs names a USB device by its bus and the ports on the way from the root hub, 1-1.4.2 is port 2 of the hub at 1-1.4;
+	// the io-warrior sticks are found by the vendor ID and matched to the opened ones by the serial number
+	DIR * devices = opendir(options.usb_sysfs_path);
+	struct dirent * entry;
+	char value[USB_PORT_PATH_LENGTH];
+	const char * last_port;
+	uint32_t stick_serial_number, stick, found_sticks = 0;
+
+	if (devices == NULL)
+	{
+		printf("ERROR: Could not read the USB topology from: %s, all sticks are taken as one hub.\n", options.usb_sysfs_path);
+		return 0;
+	}
+	while ((entry = readdir(devices)) != NULL)
+	{
+		// root hubs (usb1) and interfaces (1-1.4:1.0) are no sticks
+		if (!isdigit((unsigned char)entry->d_name[0]) || strchr(entry->d_name, ':') || strlen(entry->d_name) >= USB_PORT_PATH_LENGTH) continue;
+		if (ReadSysfsAttribute(entry->d_name, "idVendor", value, sizeof(value)) || strtoul(value, NULL, 16) != IOWKIT_VENDOR_ID) continue;
+		if (ReadSysfsAttribute(entry->d_name, "serial", value, sizeof(value))) continue;
+		stick_serial_number = (uint32_t)strtoul(value, NULL, 16); // hexadecimal, like GetUsbStickSerialNumber()
+		for (stick = 0; stick < number_of_sticks && sticks[stick].stick_serial_number != stick_serial_number; stick++);
+		if (stick == number_of_sticks) continue;
+
+		strcpy(sticks[stick].port_path, entry->d_name);
+		sticks[stick].bus = (uint16_t)strtoul(entry->d_name, NULL, 10);
+		if ((last_port = strrchr(entry->d_name, '.')) != NULL) sprintf(sticks[stick].hub_path, "%.*s", (int)(last_port - entry->d_name), entry->d_name);
+		else sprintf(sticks[stick].hub_path, "usb%u", sticks[stick].bus);
+		found_sticks++;
+	}
+	closedir(devices);
+	return found_sticks;
+}
+
+int CompareSticksTopology(const void * a, const void * b)
+{
+	// by controller, hub and port, so the sticks of a hub are next to each other
+	const STICK_TOPOLOGY * first = (const STICK_TOPOLOGY *)a;
+	const STICK_TOPOLOGY * second = (const STICK_TOPOLOGY *)b;
+	int order;
+
+	if (first->bus != second->bus) return (first->bus > second->bus) - (first->bus < second->bus);
+	if ((order = strcmp(first->hub_path, second->hub_path)) != 0) return order;
+	if ((order = strcmp(first->port_path, second->port_path)) != 0) return order;
+	return (first->stick_serial_number > second->stick_serial_number) - (first->stick_serial_number < second->stick_serial_number);
+}
+
+void * SweepWorkerThread(void * argument)
+{
+	SWEEP_WORKER * worker = (SWEEP_WORKER *)argument;
+	double sweep_start;
+
+	sweep_phase_time = worker->phase_time;
+	usb_watchdog_slot = &usb_watchdog.slots[worker - sweep_workers.workers + 1];
+	SetTraceThreadName("sweep worker");
+
+	pthread_mutex_lock(&sweep_workers.mutex);
+	while (1)
+	{
+		while (sweep_workers.running && (worker->generation == sweep_workers.generation || worker >= sweep_workers.workers + sweep_workers.number_of_workers))
+			pthread_cond_wait(&sweep_workers.start, &sweep_workers.mutex);
+		if (!sweep_workers.running) break;
+		worker->generation = sweep_workers.generation;
+		pthread_mutex_unlock(&sweep_workers.mutex);
+
+		memset(worker->phase_time, 0x00, sizeof(worker->phase_time));
+		sweep_start = GetMonotonicTime();
+		worker->result = SweepSensors(sweep_workers.sensors_table, worker->sensors, worker->number_of_sensors, worker->slots);
+		worker->sweep_time = GetMonotonicTime() - sweep_start;
+
+		pthread_mutex_lock(&sweep_workers.mutex);
+		if (--sweep_workers.pending == 0) pthread_cond_signal(&sweep_workers.done);
+	}
+	pthread_mutex_unlock(&sweep_workers.mutex);
+	return NULL;
+}
+
+void StopSweepWorkers(void)
+{
+	uint32_t worker = 0;
+
+	pthread_mutex_lock(&sweep_workers.mutex);
+	sweep_workers.running = 0;
+	pthread_cond_broadcast(&sweep_workers.start);
+	pthread_mutex_unlock(&sweep_workers.mutex);
+	for (worker = 0; worker < sweep_workers.number_of_threads; worker++) pthread_join(sweep_workers.workers[worker].thread, NULL);
+	sweep_workers.number_of_threads = 0;
+	sweep_workers.number_of_workers = 0;
+}
+
+int StartSweepWorkers(void)
+{
+	// threads for the workers of a larger layout than any before; a worker gets the scheduling policy and priority of the
+	// acquisition thread explicitly, but not its CPU pinning, the workers of different controllers must run on different CPUs
+	pthread_attr_t attributes;
+	struct sched_param parameters;
+	int policy = SCHED_OTHER, result = 0;
+	uint32_t first_thread = sweep_workers.number_of_threads;
+
+	if (sweep_workers.number_of_threads >= sweep_workers.number_of_workers) return 0;
+	if (!CPU_COUNT(&sweep_workers.cpus)) sched_getaffinity(0, sizeof(sweep_workers.cpus), &sweep_workers.cpus);
+	pthread_getschedparam(pthread_self(), &policy, &parameters);
+	policy &= ~SCHED_RESET_ON_FORK; // set along with SCHED_FIFO by SetRealtimeScheduling, not a policy of its own
+	pthread_attr_init(&attributes);
+	pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attributes, policy);
+	pthread_attr_setschedparam(&attributes, &parameters);
+	pthread_attr_setaffinity_np(&attributes, sizeof(sweep_workers.cpus), &sweep_workers.cpus);
+	pthread_attr_setstacksize(&attributes, SWEEP_WORKER_STACK_SIZE);
+
+	sweep_workers.running = 1;
+	for (; sweep_workers.number_of_threads < sweep_workers.number_of_workers; sweep_workers.number_of_threads++)
+	{
+		if ((result = pthread_create(&sweep_workers.workers[sweep_workers.number_of_threads].thread, &attributes, SweepWorkerThread, &sweep_workers.workers[sweep_workers.number_of_threads])))
+		{
+			printf("ERROR: Could not start sweep worker %u: %s, the acquisition thread sweeps all sensors.\n", sweep_workers.number_of_threads, strerror(result));
+			pthread_mutex_lock(&sweep_workers.mutex);
+			sweep_workers.number_of_workers = 0;
+			pthread_mutex_unlock(&sweep_workers.mutex);
+			result = -1;
+			break;
+		}
+	}
+	pthread_attr_destroy(&attributes);
+	if (result) return result;
+	if (policy == SCHED_FIFO) printf("Sweep workers %u to %u run under SCHED_FIFO with priority %i on %i CPUs.\n", first_thread, sweep_workers.number_of_threads - 1,
+		parameters.sched_priority, CPU_COUNT(&sweep_workers.cpus));
+	else printf("Sweep workers %u to %u run on %i CPUs.\n", first_thread, sweep_workers.number_of_threads - 1, CPU_COUNT(&sweep_workers.cpus));
+	return 0;
+}
+
+void LayOutSweepWorkers(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the sticks with bound sensors are sorted by controller and hub, every hub gets at most options.hub_workers workers and
+	// its sticks are dealt to them in turn; all sensors of a stick stay with one worker, no stick is used by two threads
+	STICK_TOPOLOGY * sticks = sweep_workers.sticks;
+	SWEEP_WORKER * worker;
+	uint32_t number_of_sticks = 0, stick = 0, hub_start = 0, hub_sticks = 0, lanes = 0;
+	uint32_t found_sticks = 0, controllers = 0, hubs = 0, number_of_workers = 0, worker_index = 0;
+	uint16_t sensors_iterator = 0, number_of_slots = 0;
+	int32_t sensor = -1;
+
+	sweep_workers.layout_changed = 0;
+	if (options.worker_layout == WORKERS_SINGLE) return;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		if (!sensors_table[sensors_iterator].stick_serial_number || FindStickSensors(sensors_table, sensors_table[sensors_iterator].stick_serial_number) != sensors_iterator) continue;
+		for (sensor = sensors_iterator; sensor >= 0 && !sensors_table[sensor].usb_stick_handle; sensor = sensors_table[sensor].next_on_stick);
+		if (sensor < 0) continue;
+		memset(&sticks[number_of_sticks], 0x00, sizeof(STICK_TOPOLOGY));
+		sticks[number_of_sticks].stick_serial_number = sensors_table[sensors_iterator].stick_serial_number;
+		sticks[number_of_sticks].first_sensor = sensors_iterator;
+		strcpy(sticks[number_of_sticks].hub_path, "unknown");
+		number_of_sticks++;
+	}
+	if (options.worker_layout == WORKERS_TOPOLOGY)
+	{
+		found_sticks = MapStickTopology(sticks, number_of_sticks);
+		qsort(sticks, number_of_sticks, sizeof(STICK_TOPOLOGY), CompareSticksTopology);
+	}
+
+	printf("\n-- Sweep workers (%s layout) -----------------------\n", worker_layout_names[options.worker_layout]);
+	for (stick = 0; stick < number_of_sticks; stick++)
+	{
+		if (options.worker_layout == WORKERS_STICK)
+		{
+			sticks[stick].worker = number_of_workers++;
+			continue;
+		}
+		if (stick == hub_start + hub_sticks)
+		{
+			// first stick of the next hub
+			hub_start = stick;
+			for (hub_sticks = 1; stick + hub_sticks < number_of_sticks && sticks[stick + hub_sticks].bus == sticks[stick].bus &&
+				!strcmp(sticks[stick + hub_sticks].hub_path, sticks[stick].hub_path); hub_sticks++);
+			lanes = hub_sticks < options.hub_workers ? hub_sticks : options.hub_workers;
+			if (!stick || sticks[stick].bus != sticks[stick - 1].bus) controllers++;
+			hubs++;
+			number_of_workers += lanes;
+			printf("   bus %-3u hub %-16s %3u sticks, %u workers\n", sticks[stick].bus, sticks[stick].hub_path, hub_sticks, lanes);
+		}
+		sticks[stick].worker = number_of_workers - lanes + (stick - hub_start) % lanes;
+	}
+	if (number_of_workers > MAX_SWEEP_WORKERS)
+	{
+		printf("   %u workers are more than %u, their sticks are dealt to the first ones.\n", number_of_workers, MAX_SWEEP_WORKERS);
+		for (stick = 0; stick < number_of_sticks; stick++) sticks[stick].worker %= MAX_SWEEP_WORKERS;
+		number_of_workers = MAX_SWEEP_WORKERS;
+	}
+
+	// the workers are idle between sweeps, they see the new layout when they take the mutex for the next one
+	pthread_mutex_lock(&sweep_workers.mutex);
+	for (worker_index = 0; worker_index < number_of_workers; worker_index++)
+	{
+		worker = &sweep_workers.workers[worker_index];
+		worker->number_of_sensors = 0;
+		worker->sensors = &sweep_workers.sensors[number_of_slots];
+		worker->slots = &sweep_workers.slots[number_of_slots];
+		worker->generation = sweep_workers.generation;
+		for (stick = 0; stick < number_of_sticks; stick++)
+		{
+			if (sticks[stick].worker != worker_index) continue;
+			for (sensor = sticks[stick].first_sensor; sensor >= 0; sensor = sensors_table[sensor].next_on_stick) worker->sensors[worker->number_of_sensors++] = (uint16_t)sensor;
+		}
+		number_of_slots += worker->number_of_sensors;
+	}
+	sweep_workers.number_of_workers = number_of_workers;
+	pthread_mutex_unlock(&sweep_workers.mutex);
+
+	printf("   %u workers for %u sticks", number_of_workers, number_of_sticks);
+	if (options.worker_layout == WORKERS_TOPOLOGY)
+	{
+		printf(" on %u hubs of %u USB controllers", hubs, controllers);
+		if (found_sticks < number_of_sticks) printf(", %u sticks not found in %s", number_of_sticks - found_sticks, options.usb_sysfs_path);
+	}
+	printf("\n----------------------------------------------------------\n\n");
+	StartSweepWorkers();
+}
+
+int UpdateSensorsMeasurements(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the sweep workers sweep their sticks in parallel while the acquisition thread waits, the phases of the slowest worker
+	// are the critical path of the sweep and go to the phase timing
+	SWEEP_WORKER * worker, * slowest = NULL;
+	uint8_t phase = 0;
+	int result = 0;
+
+	if (sweep_workers.layout_changed) LayOutSweepWorkers(sensors_table, number_of_sensors);
+	if (!sweep_workers.number_of_workers) return SweepSensors(sensors_table, NULL, number_of_sensors, sweep_workers.slots);
+
+	pthread_mutex_lock(&sweep_workers.mutex);
+	sweep_workers.sensors_table = sensors_table;
+	sweep_workers.pending = sweep_workers.number_of_workers;
+	sweep_workers.generation++;
+	pthread_cond_broadcast(&sweep_workers.start);
+	while (sweep_workers.pending) pthread_cond_wait(&sweep_workers.done, &sweep_workers.mutex);
+	pthread_mutex_unlock(&sweep_workers.mutex);
+
+	for (worker = sweep_workers.workers; worker < sweep_workers.workers + sweep_workers.number_of_workers; worker++)
+	{
+		if (worker->result && !result) result = worker->result;
+		if (!slowest || worker->sweep_time > slowest->sweep_time) slowest = worker;
+	}
+	for (phase = 0; phase < NUMBER_OF_SWEEP_PHASES; phase++) sweep_phase_time[phase] += slowest->phase_time[phase];
+	return result;
+}
+
+size_t GetVirtualProgramLength(const uint8_t * program)
+{
+	// bytes before VIRTUAL_END, operands may contain zero bytes
+	const uint8_t * code = program;
+	while (* code != VIRTUAL_END) code += (* code == VIRTUAL_CONSTANT) ? 1 + sizeof(float) : (* code == VIRTUAL_CHANNEL) ? 4 : 1;
+	return (size_t)(code - program);
+}
+
+float RunVirtualProgram(SHTW1_SENSOR sensors_table[], const uint8_t * program, double * sample_time)
+{
+	// the stack depth was checked by the compiler, * sample_time gets the newest sample of the sources
+	float stack[VIRTUAL_STACK_DEPTH];
+	uint8_t depth = 0;
+	float value;
+	SHTW1_SENSOR * source;
+
+	while (* program != VIRTUAL_END)
+	{
+		switch (* program++)
+		{
+			case VIRTUAL_CONSTANT:
+				memcpy(&stack[depth++], program, sizeof(float));
+				program += sizeof(float);
+				break;
+			case VIRTUAL_CHANNEL:
+				source = &sensors_table[(program[0] << 8) | program[1]];
+				value = (program[2] == VIRTUAL_T) ? source->temperature : (program[2] == VIRTUAL_RH) ? source->humidity : source->dew_point;
+				program += 3;
+				if (value == VIRTUAL_UNDEFINED) return VIRTUAL_UNDEFINED;
+				if (source->sample_time > * sample_time) * sample_time = source->sample_time;
+				stack[depth++] = value;
+				break;
+			case VIRTUAL_ADD:
+				depth--;
+				stack[depth - 1] += stack[depth];
+				break;
+			case VIRTUAL_SUBTRACT:
+				depth--;
+				stack[depth - 1] -= stack[depth];
+				break;
+			case VIRTUAL_MULTIPLY:
+				depth--;
+				stack[depth - 1] *= stack[depth];
+				break;
+			case VIRTUAL_DIVIDE:
+				depth--;
+				if (stack[depth] == 0.0) return VIRTUAL_UNDEFINED;
+				stack[depth - 1] /= stack[depth];
+				break;
+			case VIRTUAL_NEGATE:
+				stack[depth - 1] = -stack[depth - 1];
+				break;
+		}
+	}
+	return stack[0];
+}
+
+void EvaluateVirtualSensors(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// one pass in table order after every sweep, so the virtual sensors used by an expression are already updated,
+	// a virtual sensor gets a sample when any of its sources has a new one, it carries the time of the newest
+	uint16_t sensors_iterator;
+	uint8_t channel;
+	double sample_time;
+	float values[NUMBER_OF_VIRTUAL_CHANNELS];
+	SHTW1_SENSOR * sensor;
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		sensor = &sensors_table[sensors_iterator];
+		if (sensor->stick_serial_number) continue;
+		sample_time = 0.0;
+		for (channel = 0; channel < NUMBER_OF_VIRTUAL_CHANNELS; channel++)
+			values[channel] = sensor->programs[channel] ? RunVirtualProgram(sensors_table, sensor->programs[channel], &sample_time) : VIRTUAL_UNDEFINED;
+		if (sample_time <= sensor->sample_time) continue;
+		sensor->temperature = values[VIRTUAL_T];
+		sensor->humidity = values[VIRTUAL_RH];
+		sensor->dew_point = values[VIRTUAL_DP];
+		sensor->sample_time = sample_time;
+		sensor->fresh = 1;
+		AddToHistory(sensor);
+	}
+}
+
+int PrintSensorsMeasurements(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	while (number_of_sensors)
+	{
+		number_of_sensors--;
+		if (!(sensors_table[number_of_sensors].sinks & SINK_CONSOLE)) continue;
+		printf("   T: %.2f[*C], RH: %.2f[%], DewP: %.2f[*C] <--- %s\n", sensors_table[number_of_sensors].temperature, sensors_table[number_of_sensors].humidity, sensors_table[number_of_sensors].dew_point, sensors_table[number_of_sensors].name);
+	}
+}
+
+int PrintVirtualSensors(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	uint8_t channel;
+
+	printf("Virtual sensors list:\n");
+	while (number_of_sensors)
+	{
+		number_of_sensors--;
+		printf("-----------------------------------------------\n");
+		printf("Name: %s\n", sensors_table[number_of_sensors].name);
+		if (!sensors_table[number_of_sensors].stick_serial_number)
+		{
+			printf("Computed channels:");
+			for (channel = 0; channel < NUMBER_OF_VIRTUAL_CHANNELS; channel++)
+				if (sensors_table[number_of_sensors].programs[channel])
+					printf(" %s (%u bytes of bytecode)", virtual_channel_names[channel], (unsigned int)GetVirtualProgramLength(sensors_table[number_of_sensors].programs[channel]) + 1);
+			printf("\n");
+			printf("T: %.2f\n", sensors_table[number_of_sensors].temperature);
+			printf("RH: %.2f\n", sensors_table[number_of_sensors].humidity);
+			printf("DP: %.2f\n", sensors_table[number_of_sensors].dew_point);
+			printf("Info: %s\n", sensors_table[number_of_sensors].info);
+			printf("-----------------------------------------------\n");
+			continue;
+		}
+		printf("Stick S/N: %i\n", sensors_table[number_of_sensors].stick_serial_number);
+		printf("I2C address: 0x%02X", sensors_table[number_of_sensors].i2c_address);
+		if (sensors_table[number_of_sensors].i2c_clock_khz) printf(", clock: %u[kHz]", sensors_table[number_of_sensors].i2c_clock_khz);
+		printf("\n");
+		printf("Mode: %s, readout: %s, channels: %s, period: %u[ms]", measurement_mode_names[sensors_table[number_of_sensors].measurement_mode],
+			readout_names[sensors_table[number_of_sensors].readout], channel_selection_names[sensors_table[number_of_sensors].channels], sensors_table[number_of_sensors].period_ms);
+		if (sensors_table[number_of_sensors].max_period_ms) printf(", adaptive up to %u[ms]", sensors_table[number_of_sensors].max_period_ms);
+		printf("\n");
+		printf("Calibration: T %+.2f[*C], RH %+.2f[%%]\n", sensors_table[number_of_sensors].temperature_offset, sensors_table[number_of_sensors].humidity_offset);
+		printf("T: %.2f\n", sensors_table[number_of_sensors].temperature);
+		printf("RH: %.2f\n", sensors_table[number_of_sensors].humidity);
+		printf("DP: %.2f\n", sensors_table[number_of_sensors].dew_point);
+		printf("Handle: %u\n", sensors_table[number_of_sensors].usb_stick_handle);
+		printf("Info: %s\n", sensors_table[number_of_sensors].info);
+		printf("-----------------------------------------------\n");
+	}
+}
+
+char * StoreSensorName(const char * name, size_t length)
+{
+	// copies the name into the name pool, one malloc per NAME_POOL_CHUNK_SIZE bytes of names
+	NAME_POOL_CHUNK * chunk = sensor_names;
+	char * stored;
+
+	if (chunk == NULL || chunk->size - chunk->used < length + 1)
+	{
+		chunk = malloc(sizeof(NAME_POOL_CHUNK) + (length + 1 > NAME_POOL_CHUNK_SIZE ? length + 1 : NAME_POOL_CHUNK_SIZE));
+		if (chunk == NULL) return NULL;
+		chunk->size = length + 1 > NAME_POOL_CHUNK_SIZE ? length + 1 : NAME_POOL_CHUNK_SIZE;
+		chunk->used = 0;
+		chunk->next = sensor_names;
+		sensor_names = chunk;
+	}
+	stored = chunk->names + chunk->used;
+	memcpy(stored, name, length);
+	stored[length] = 0;
+	chunk->used += length + 1;
+	return stored;
+}
+
+void EmitVirtualCode(VIRTUAL_COMPILER * compiler, const uint8_t code[], size_t length, int8_t depth_change)
+{
+	if (compiler->error) return;
+	if (compiler->length + length > VIRTUAL_PROGRAM_SIZE)
+	{
+		compiler->error = "expression too long";
+		return;
+	}
+	memcpy(&compiler->program[compiler->length], code, length);
+	compiler->length += length;
+	compiler->depth += depth_change;
+	if (compiler->depth > VIRTUAL_STACK_DEPTH) compiler->error = "expression nested too deep";
+}
+
+void EmitVirtualOperation(VIRTUAL_COMPILER * compiler, uint8_t opcode, int8_t depth_change)
+{
+	EmitVirtualCode(compiler, &opcode, 1, depth_change);
+}
+
+void CompileVirtualExpression(VIRTUAL_COMPILER * compiler);
+
+void CompileVirtualPrimary(VIRTUAL_COMPILER * compiler)
+{
+	// <number> | <sensor>.<t|rh|dp> | (<expression>)
+	char * start = compiler->position;
+	char * end = NULL;
+	char separator;
+	uint8_t code[1 + sizeof(float)];
+	float value;
+	uint32_t slot;
+	int32_t sensor = -1;
+	uint8_t channel;
+
+	if (compiler->error) return;
+	if (* start == '(')
+	{
+		compiler->position++;
+		CompileVirtualExpression(compiler);
+		if (compiler->error) return;
+		if (* compiler->position != ')') compiler->error = "missing ')'";
+		else compiler->position++;
+		return;
+	}
+	if (isdigit((unsigned char)* start) || * start == '.')
+	{
+		value = strtof(start, &end);
+		if (end == start)
+		{
+			compiler->error = "expected a number";
+			return;
+		}
+		code[0] = VIRTUAL_CONSTANT;
+		memcpy(&code[1], &value, sizeof(float));
+		EmitVirtualCode(compiler, code, sizeof(code), 1);
+		compiler->position = end;
+		return;
+	}
+
+	// the name is looked up in place, terminated for a moment at the '.'
+	for (end = start; isalnum((unsigned char)* end) || * end == '_'; end++);
+	if (end == start || * end != '.')
+	{
+		compiler->error = "expected a number, '(' or <sensor>.<t|rh|dp>, sensor names in expressions are letters, digits and '_'";
+		return;
+	}
+	separator = * end;
+	* end = 0;
+	for (slot = HashSensorName(start) & (SENSOR_INDEX_SIZE - 1); compiler->name_index[slot] >= 0; slot = (slot + 1) & (SENSOR_INDEX_SIZE - 1))
+		if (strcmp(compiler->table[compiler->name_index[slot]].name, start) == 0) break;
+	sensor = compiler->name_index[slot];
+	* end = separator;
+	if (sensor < 0)
+	{
+		compiler->error = "unknown sensor, an expression may use only the sensors defined above it";
+		return;
+	}
+
+	compiler->position = start = end + 1;
+	for (end = start; isalpha((unsigned char)* end); end++);
+	for (channel = 0; channel < NUMBER_OF_VIRTUAL_CHANNELS; channel++)
+		if (strlen(virtual_channel_names[channel]) == (size_t)(end - start) && strncmp(start, virtual_channel_names[channel], end - start) == 0) break;
+	if (channel == NUMBER_OF_VIRTUAL_CHANNELS)
+	{
+		compiler->error = "unknown channel, expected t, rh or dp";
+		return;
+	}
+	code[0] = VIRTUAL_CHANNEL;
+	code[1] = (uint8_t)(sensor >> 8);
+	code[2] = (uint8_t)(sensor & 0xFF);
+	code[3] = channel;
+	EmitVirtualCode(compiler, code, 4, 1);
+	compiler->position = end;
+}
+
+void CompileVirtualUnary(VIRTUAL_COMPILER * compiler)
+{
+	if (* compiler->position == '-')
+	{
+		compiler->position++;
+		CompileVirtualUnary(compiler);
+		EmitVirtualOperation(compiler, VIRTUAL_NEGATE, 0);
+	}
+	else CompileVirtualPrimary(compiler);
+}
+
+void CompileVirtualTerm(VIRTUAL_COMPILER * compiler)
+{
+	char operator;
+	CompileVirtualUnary(compiler);
+	while (!compiler->error && (* compiler->position == '*' || * compiler->position == '/'))
+	{
+		operator = * compiler->position++;
+		CompileVirtualUnary(compiler);
+		EmitVirtualOperation(compiler, operator == '*' ? VIRTUAL_MULTIPLY : VIRTUAL_DIVIDE, -1);
+	}
+}
+
+void CompileVirtualExpression(VIRTUAL_COMPILER * compiler)
+{
+	char operator;
+	CompileVirtualTerm(compiler);
+	while (!compiler->error && (* compiler->position == '+' || * compiler->position == '-'))
+	{
+		operator = * compiler->position++;
+		CompileVirtualTerm(compiler);
+		EmitVirtualOperation(compiler, operator == '+' ? VIRTUAL_ADD : VIRTUAL_SUBTRACT, -1);
+	}
+}
+
+const uint8_t * CompileVirtualChannel(VIRTUAL_COMPILER * compiler, char * expression, char ** error_position)
+{
+	// the whole value is one expression without white space, its bytecode is kept in the name pool of the configuration
+	const uint8_t * program = NULL;
+
+	compiler->position = expression;
+	compiler->length = 0;
+	compiler->depth = 0;
+	compiler->error = NULL;
+	CompileVirtualExpression(compiler);
+	if (!compiler->error && * compiler->position) compiler->error = "expected an operator +, -, * or /";
+	EmitVirtualOperation(compiler, VIRTUAL_END, 0);
+	if (!compiler->error && (program = (const uint8_t *)StoreSensorName((const char *)compiler->program, compiler->length)) == NULL) compiler->error = "out of memory";
+	if (compiler->error) * error_position = compiler->position;
+	return program;
+}
+
+const char * ParseSensorOption(SHTW1_SENSOR * sensor, char * option, char ** error_position, VIRTUAL_COMPILER * compiler)
+{
+	// <key>=<value>, returns NULL or the description of the error found at * error_position
+	// expressions of a virtual sensor are compiled with the sensors known to the compiler
+	char * value = strchr(option, '=');
+	char * end = NULL;
+	char * item = NULL;
+	unsigned long number = 0;
+	double offset = 0.0;
+	uint8_t key = 0, sink = 0;
+
+	* error_position = option;
+	if (value == NULL) return "expected <key>=<value>";
+	* value++ = 0;
+	for (key = 0; key < NUMBER_OF_CONFIGURATION_KEYS; key++) if (strcmp(option, configuration_keys[key]) == 0) break;
+	if (key == NUMBER_OF_CONFIGURATION_KEYS) return "unknown key, expected period, mode, address, t_offset, rh_offset, sinks, derived, max_period, channels, readout, i2c_clock, t, rh or dp";
+	if (!sensor->stick_serial_number && key != KEY_SINKS && key != KEY_T && key != KEY_RH && key != KEY_DP) return "a virtual sensor takes only t, rh, dp and sinks";
+	if (sensor->stick_serial_number && (key == KEY_T || key == KEY_RH || key == KEY_DP)) return "t, rh and dp expressions are for virtual sensors only";
+
+	* error_position = value;
+	if (!* value) return "missing value";
+	switch (key)
+	{
+		case KEY_PERIOD:
+			number = strtoul(value, &end, 10);
+			if (* end || * value == '-' || number > MAX_SAMPLE_PERIOD_MS) return "sample period must be a number of milliseconds, at most 3600000";
+			sensor->period_ms = (uint32_t)number;
+			break;
+		case KEY_MODE:
+			for (sensor->measurement_mode = 0; sensor->measurement_mode < NUMBER_OF_MEASUREMENT_MODES; sensor->measurement_mode++)
+				if (strcmp(value, measurement_mode_names[sensor->measurement_mode]) == 0) break;
+			if (sensor->measurement_mode == NUMBER_OF_MEASUREMENT_MODES) return "unknown measurement mode, expected normal or low_power";
+			break;
+		case KEY_ADDRESS:
+			number = strtoul(value, &end, 0);
+			if (* end || * value == '-' || number < I2C_MIN_ADDRESS || number > I2C_MAX_ADDRESS) return "I2C address must be a 7bit address from 0x08 to 0x77";
+			sensor->i2c_address = (uint8_t)number;
+			break;
+		case KEY_T_OFFSET:
+		case KEY_RH_OFFSET:
+			offset = strtod(value, &end);
+			if (* end || !(fabs(offset) <= MAX_CALIBRATION_OFFSET)) return "calibration offset must be a number from -50 to 50";
+			if (key == KEY_T_OFFSET) sensor->temperature_offset = (float)offset;
+			else sensor->humidity_offset = (float)offset;
+			break;
+		case KEY_SINKS:
+			sensor->sinks = 0;
+			if (strcmp(value, "none") == 0) break;
+			for (item = value; item; item = end)
+			{
+				end = strchr(item, ',');
+				if (end) * end++ = 0;
+				for (sink = 0; sink < sizeof(sink_names) / sizeof(sink_names[0]); sink++) if (strcmp(item, sink_names[sink]) == 0) break;
+				* error_position = item;
+				if (sink == sizeof(sink_names) / sizeof(sink_names[0])) return "unknown sink, expected a comma separated list of records, plot, console or none";
+				sensor->sinks |= (uint8_t)(1 << sink);
+			}
+			break;
+		case KEY_DERIVED:
+			if (strcmp(value, "dew_point") == 0) sensor->derived_channels = DERIVED_DEW_POINT;
+			else if (strcmp(value, "none") == 0) sensor->derived_channels = 0;
+			else return "unknown derived channel, expected dew_point or none";
+			break;
+		case KEY_MAX_PERIOD:
+			number = strtoul(value, &end, 10);
+			if (* end || * value == '-' || number > MAX_SAMPLE_PERIOD_MS) return "maximum sample period must be a number of milliseconds, at most 3600000";
+			sensor->max_period_ms = (uint32_t)number;
+			break;
+		case KEY_CHANNELS:
+			for (sensor->channels = 0; sensor->channels < NUMBER_OF_CHANNEL_SELECTIONS; sensor->channels++)
+				if (strcmp(value, channel_selection_names[sensor->channels]) == 0) break;
+			if (sensor->channels == NUMBER_OF_CHANNEL_SELECTIONS) return "unknown channels, expected t_rh, t or rh";
+			break;
+		case KEY_I2C_CLOCK:
+			number = strtoul(value, &end, 10);
+			if (* end || * value == '-' || !number || number > I2C_MAX_CLOCK_KHZ) return "I2C clock must be a number of kHz, at most 3400";
+			sensor->i2c_clock_khz = (uint16_t)number;
+			break;
+		case KEY_READOUT:
+			for (sensor->readout = 0; sensor->readout < NUMBER_OF_READOUTS; sensor->readout++)
+				if (strcmp(value, readout_names[sensor->readout]) == 0) break;
+			if (sensor->readout == NUMBER_OF_READOUTS) return "unknown readout, expected polling, clock_stretching or periodic";
+			break;
+		case KEY_T:
+		case KEY_RH:
+		case KEY_DP:
+			if (compiler == NULL) return "virtual sensors can not be defined here";
+			sensor->programs[key - KEY_T] = CompileVirtualChannel(compiler, value, error_position);
+			if (sensor->programs[key - KEY_T] == NULL) return compiler->error;
+			break;
+	}
+	return NULL;
+}
+
+void PrintConfigurationError(uint32_t line_number, uint32_t column, const char * message)
+{
+	printf("ERROR: %s:%u:%u: %s\n", options.configuration_path, line_number, column, message);
+}
+
+int LoadConfiguration(SHTW1_SENSOR table_of_sensors[], uint16_t * number_of_sensors)
+{
+	// streaming parser: every line is validated once, all errors are reported with their line and column
+	FILE * config_file;
+	char * line = NULL;
+	char * field = NULL;
+	char * field_end = NULL;
+	char * end = NULL;
+	char * error_position = NULL;
+	const char * error = NULL;
+	size_t len = 0, name_length = 0;
+	ssize_t read;
+	uint32_t line_number = 0, errors_number = 0;
+	uint16_t sensors_iterator = 0;
+	unsigned long stick_serial_number = 0;
+	int32_t duplicate = -1, same_stick = -1;
+	uint32_t slot = 0;
+	int section = 0; // 0 = before "sensors:", 1 = inside, 2 = after "end."
+	int32_t name_index[SENSOR_INDEX_SIZE]; // sensor name hash index, for duplicate names
+	SHTW1_SENSOR overflow_sensor; // parsed and validated, but never stored
+	SHTW1_SENSOR * new_sensor;
+	VIRTUAL_COMPILER compiler = { .table = table_of_sensors, .name_index = name_index };
+
+	* number_of_sensors = 0;
+	memset(sensor_index, 0xFF, sizeof(sensor_index));
+	memset(name_index, 0xFF, sizeof(name_index));
+
+	config_file = fopen(options.configuration_path, "r");
+
+	if (config_file == NULL)
+	{ 
+		printf("ERROR: Missing configuration file: %s\n", options.configuration_path);
+		return -1;
+	}
+
+	printf("\nReading the configuration file...\n\n");
+	while (section < 2 && (read = getline(&line, &len, config_file)) != -1) 
+	{
+		line_number++;
+		while (read && (line[read - 1] == '\n' || line[read - 1] == '\r')) line[--read] = 0;
+
+		// ignore the content until you find a starting phrase
+		if (section == 0)
+		{
+			if (strcmp(line, SENSOR_BINDING_LIST_START) == 0) section = 1;
+			continue;
+		}
+		field = line + strspn(line, SEPARATION_CHARS);
+		if (!* field || * field == COMMENT_CHAR) continue;
+		if (strcmp(field, BINDING_LIST_STOP) == 0)
+		{
+			section = 2;
+			continue;
+		}
+
+		// sensors are parsed in place, the table entry stays unused until the line is valid
+		new_sensor = (sensors_iterator < MAX_NUMBER_OF_SENSORS) ? &table_of_sensors[sensors_iterator] : &overflow_sensor;
+		* new_sensor = (SHTW1_SENSOR){ .temperature = 1000.0, .humidity = 1000.0, .dew_point = 1000.0, .info = "ERROR: USB Stick not found!\0",
+			.configuration_line = line_number, .i2c_address = I2C_DEFAULT_ADDRESS, .measurement_mode = MODE_NORMAL, .sinks = ALL_SINKS,
+			.derived_channels = DERIVED_DEW_POINT, .next_on_stick = -1 };
+
+		// <name>, letters, digits, '_', '.' and '-', it is used inside gnuplot commands and the shell pipelines they start
+		field_end = field + strcspn(field, SEPARATION_CHARS);
+		error = NULL;
+		for (end = field; end < field_end && !error; end++)
+			if (!IsPlainName(end, 1)) error = "sensor name may only contain letters, digits, '_', '.' and '-'";
+		if (error)
+		{
+			PrintConfigurationError(line_number, (uint32_t)(end - line), error);
+			errors_number++;
+			continue;
+		}
+		new_sensor->name = field;
+		name_length = (size_t)(field_end - field);
+
+		// <stick_serial_number>
+		if (* field_end) * field_end++ = 0;
+		field = field_end + strspn(field_end, SEPARATION_CHARS);
+		field_end = field + strcspn(field, SEPARATION_CHARS);
+		if (field == field_end)
+		{
+			PrintConfigurationError(line_number, (uint32_t)(field - line + 1), "missing decimal USB stick serial number after the sensor name");
+			errors_number++;
+			continue;
+		}
+		if (* field_end) * field_end++ = 0;
+		stick_serial_number = strtoul(field, &end, 10);
+		if (strcmp(field, VIRTUAL_STICK) == 0) stick_serial_number = 0; // computed from the sensors above it
+		else if (* end || * field == '-' || !stick_serial_number || stick_serial_number > UINT32_MAX)
+		{
+			PrintConfigurationError(line_number, (uint32_t)(field - line + 1), "USB stick serial number must be a positive decimal number or \"" VIRTUAL_STICK "\"");
+			errors_number++;
+			continue;
+		}
+		new_sensor->stick_serial_number = (uint32_t)stick_serial_number;
+
+		// [<key>=<value> ...]
+		error = NULL;
+		while (!error)
+		{
+			field = field_end + strspn(field_end, SEPARATION_CHARS);
+			if (!* field || * field == COMMENT_CHAR) break;
+			field_end = field + strcspn(field, SEPARATION_CHARS);
+			if (* field_end) * field_end++ = 0;
+			error = ParseSensorOption(new_sensor, field, &error_position, &compiler);
+		}
+		if (error)
+		{
+			PrintConfigurationError(line_number, (uint32_t)(error_position - line + 1), error);
+			errors_number++;
+			continue;
+		}
+		if (new_sensor->max_period_ms && new_sensor->max_period_ms <= new_sensor->period_ms)
+		{
+			PrintConfigurationError(line_number, 1, "max_period must be longer than period, the fastest sample period of an adaptive sensor");
+			errors_number++;
+			continue;
+		}
+		if (!new_sensor->stick_serial_number && !new_sensor->programs[VIRTUAL_T] && !new_sensor->programs[VIRTUAL_RH] && !new_sensor->programs[VIRTUAL_DP])
+		{
+			PrintConfigurationError(line_number, 1, "virtual sensor needs at least one of the t, rh or dp expressions");
+			errors_number++;
+			continue;
+		}
+
+		if (sensors_iterator >= MAX_NUMBER_OF_SENSORS)
+		{
+			PrintConfigurationError(line_number, 1, "too many sensor entities");
+			printf("\t system can hold only: %u\n", MAX_NUMBER_OF_SENSORS);
+			errors_number++;
+			continue;
+		}
+
+		// virtual sensors are not bound to a stick, they stay out of the stick serial number index
+		if (!new_sensor->stick_serial_number) strncpy(new_sensor->info, "OK: Virtual Sensor\0", MAX_SENSOR_INFO_LENGTH);
+
+		// the clock is set for the whole stick, sensors without i2c_clock take the clock of the other sensors
+		same_stick = new_sensor->stick_serial_number ? FindStickSensors(table_of_sensors, new_sensor->stick_serial_number) : -1;
+		if (same_stick >= 0 && new_sensor->i2c_clock_khz && table_of_sensors[same_stick].i2c_clock_khz &&
+			new_sensor->i2c_clock_khz != table_of_sensors[same_stick].i2c_clock_khz)
+		{
+			PrintConfigurationError(line_number, 1, "I2C clock differs from another sensor on the same USB stick");
+			printf("\t sensor \"%s\" in line %u\n", table_of_sensors[same_stick].name, table_of_sensors[same_stick].configuration_line);
+			errors_number++;
+			continue;
+		}
+
+		duplicate = AddToSensorIndex(table_of_sensors, sensors_iterator);
+		if (duplicate >= 0)
+		{
+			PrintConfigurationError(line_number, 1, "USB stick and I2C address already used by another sensor");
+			printf("\t sensor \"%s\" in line %u\n", table_of_sensors[duplicate].name, table_of_sensors[duplicate].configuration_line);
+			errors_number++;
+			continue;
+		}
+		if (same_stick >= 0 && !new_sensor->i2c_clock_khz) new_sensor->i2c_clock_khz = table_of_sensors[same_stick].i2c_clock_khz;
+		else if (new_sensor->i2c_clock_khz)
+			for (same_stick = new_sensor->next_on_stick; same_stick >= 0; same_stick = table_of_sensors[same_stick].next_on_stick)
+				table_of_sensors[same_stick].i2c_clock_khz = new_sensor->i2c_clock_khz;
+		new_sensor->name = StoreSensorName(new_sensor->name, name_length);
+		for (slot = HashSensorName(new_sensor->name) & (SENSOR_INDEX_SIZE - 1); name_index[slot] >= 0; slot = (slot + 1) & (SENSOR_INDEX_SIZE - 1))
+			if (strcmp(table_of_sensors[name_index[slot]].name, table_of_sensors[sensors_iterator].name) == 0) break;
+		if (name_index[slot] >= 0)
+		{
+			PrintConfigurationError(line_number, 1, "sensor name already used");
+			printf("\t sensor in line %u\n", table_of_sensors[name_index[slot]].configuration_line);
+			errors_number++;
+		}
+		else name_index[slot] = sensors_iterator;
+		sensors_iterator++;
+	}
+
+	if (section == 0) PrintConfigurationError(line_number, 1, "missing \"" SENSOR_BINDING_LIST_START "\" line starting the sensors section");
+	else if (section == 1) PrintConfigurationError(line_number, 1, "missing \"" BINDING_LIST_STOP "\" line closing the sensors section");
+	if (section < 2) errors_number++;
+
+	* number_of_sensors = sensors_iterator;
+
+	fclose(config_file);
+	if (line)
+		free(line);
+	if (errors_number)
+	{
+		printf("ERROR: %u errors in the configuration file: %s\n", errors_number, options.configuration_path);
+		return -1;
+	}
+	return 0;
+}
+
+void ReleaseConfiguration(SHTW1_SENSOR table_of_sensors[], uint16_t number_of_sensors)
+{
+	NAME_POOL_CHUNK * chunk;
+	while (number_of_sensors) table_of_sensors[--number_of_sensors].name = NULL;
+	while ((chunk = sensor_names) != NULL)
+	{
+		sensor_names = chunk->next;
+		free(chunk);
+	}
+}
+
+int GenerateSensorTable(const char * path, SHTW1_SENSOR table_of_sensors[], uint16_t number_of_sensors)
+{
+	// writes the loaded configuration and its stick serial number index as initializers for a STATIC_CONFIGURATION build
+	FILE * table_file = fopen(path, "w");
+	SHTW1_SENSOR * sensor = NULL;
+	const char * character = NULL;
+	uint16_t sensors_iterator = 0;
+	uint32_t slot = 0;
+	uint8_t channel = 0;
+	size_t code = 0;
+
+	if (table_file == NULL)
+	{
+		printf("ERROR: Could not create the sensors table file: %s\n", path);
+		return -1;
+	}
+
+	fprintf(table_file, "// generated by 'testsystem --generate-table' from: %s, do not edit\n\n", options.configuration_path);
+	fprintf(table_file, "#if SENSOR_INDEX_SIZE != %u || MAX_NUMBER_OF_SENSORS < %u\n", SENSOR_INDEX_SIZE, number_of_sensors);
+	fprintf(table_file, "#error \"sensors table generated for another testsystem, run 'make compile-static' again\"\n#endif\n\n");
+	fprintf(table_file, "#define STATIC_CONFIGURATION_SOURCE \"");
+	for (character = options.configuration_path; * character; character++)
+		fprintf(table_file, (* character == '\\' || * character == '"') ? "\\%c" : "%c", * character);
+	fprintf(table_file, "\"\n#define STATIC_NUMBER_OF_SENSORS %u\n\n#define STATIC_SENSORS_TABLE \\\n{ \\\n", number_of_sensors);
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		// names may contain backslashes, quotes are rejected by the parser
+		sensor = &table_of_sensors[sensors_iterator];
+		fprintf(table_file, "\t{ .name = \"");
+		for (character = sensor->name; * character; character++) fprintf(table_file, * character == '\\' ? "\\%c" : "%c", * character);
+		fprintf(table_file, "\", .stick_serial_number = %u, .i2c_address = 0x%02X, .measurement_mode = %u, .channels = %u, .readout = %u, .i2c_clock_khz = %u, \\\n\t  .period_ms = %u, .max_period_ms = %u, \\\n",
+			sensor->stick_serial_number, sensor->i2c_address, sensor->measurement_mode, sensor->channels, sensor->readout, sensor->i2c_clock_khz, sensor->period_ms,
+			sensor->max_period_ms);
+		fprintf(table_file, "\t  .temperature_offset = %.9g, .humidity_offset = %.9g, .sinks = 0x%02X, .derived_channels = 0x%02X, .configuration_line = %u, .next_on_stick = %d, \\\n",
+			sensor->temperature_offset, sensor->humidity_offset, sensor->sinks, sensor->derived_channels, sensor->configuration_line, sensor->next_on_stick);
+		if (!sensor->stick_serial_number)
+		{
+			// the bytecode as a string literal, its terminating zero is the VIRTUAL_END
+			fprintf(table_file, "\t  .programs = {");
+			for (channel = 0; channel < NUMBER_OF_VIRTUAL_CHANNELS; channel++)
+			{
+				if (sensor->programs[channel] == NULL) fprintf(table_file, " NULL");
+				else
+				{
+					fprintf(table_file, " (const uint8_t *)\"");
+					for (code = 0; code < GetVirtualProgramLength(sensor->programs[channel]); code++) fprintf(table_file, "\\x%02X", sensor->programs[channel][code]);
+					fprintf(table_file, "\"");
+				}
+				fprintf(table_file, channel < NUMBER_OF_VIRTUAL_CHANNELS - 1 ? "," : " }, \\\n");
+			}
+		}
+		fprintf(table_file, "\t  .temperature = %.1f, .humidity = %.1f, .dew_point = %.1f, .info = \"%s\" }, \\\n", sensor->temperature, sensor->humidity, sensor->dew_point, sensor->info);
+	}
+	fprintf(table_file, "}\n\n#define STATIC_SENSOR_INDEX \\\n{ \\\n");
+	for (slot = 0; slot < SENSOR_INDEX_SIZE; slot++)
+		fprintf(table_file, "%s%d,%s", slot % 16 ? " " : "\t", sensor_index[slot], (slot % 16 == 15) ? " \\\n" : "");
+	fprintf(table_file, "}\n");
+
+	if (fclose(table_file))
+	{
+		printf("ERROR: Could not write the sensors table file: %s\n", path);
+		return -1;
+	}
+	printf("Sensors table with %u sensors written to: %s\n", number_of_sensors, path);
+	return 0;
+}
+
+void RebuildSensorIndex(SHTW1_SENSOR table_of_sensors[], uint16_t number_of_sensors)
+{
+	uint16_t sensors_iterator = 0;
+	memset(sensor_index, 0xFF, sizeof(sensor_index));
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++) AddToSensorIndex(table_of_sensors, sensors_iterator);
+}
+
+int VirtualProgramsChanged(SHTW1_SENSOR * live, SHTW1_SENSOR * settings)
+{
+	uint8_t channel;
+	for (channel = 0; channel < NUMBER_OF_VIRTUAL_CHANNELS; channel++)
+	{
+		if (!live->programs[channel] != !settings->programs[channel]) return 1;
+		if (live->programs[channel] && (GetVirtualProgramLength(live->programs[channel]) != GetVirtualProgramLength(settings->programs[channel]) ||
+			memcmp(live->programs[channel], settings->programs[channel], GetVirtualProgramLength(live->programs[channel])))) return 1;
+	}
+	return 0;
+}
+
+int SensorSettingsChanged(SHTW1_SENSOR * live, SHTW1_SENSOR * settings)
+{
+	return strcmp(live->name, settings->name) || live->period_ms != settings->period_ms || live->max_period_ms != settings->max_period_ms ||
+		live->measurement_mode != settings->measurement_mode || live->channels != settings->channels || live->readout != settings->readout ||
+		live->temperature_offset != settings->temperature_offset || live->humidity_offset != settings->humidity_offset ||
+		live->sinks != settings->sinks || live->derived_channels != settings->derived_channels || live->i2c_clock_khz != settings->i2c_clock_khz ||
+		VirtualProgramsChanged(live, settings);
+}
+
+void KeepSensorState(SHTW1_SENSOR * sensor, SHTW1_SENSOR * live)
+{
+	// sensor gets the binding, measurements and statistics of the live sensor, but keeps its own settings and table links
+	SHTW1_SENSOR settings = * sensor;
+
+	* sensor = * live;
+	sensor->name = settings.name;
+	sensor->configuration_line = settings.configuration_line;
+	sensor->period_ms = settings.period_ms;
+	sensor->max_period_ms = settings.max_period_ms;
+	sensor->measurement_mode = settings.measurement_mode;
+	sensor->channels = settings.channels;
+	sensor->readout = settings.readout;
+	sensor->i2c_clock_khz = settings.i2c_clock_khz; // used from the next I2C enable of the stick, ReloadConfiguration re-enables it
+	sensor->temperature_offset = settings.temperature_offset;
+	sensor->humidity_offset = settings.humidity_offset;
+	sensor->sinks = settings.sinks;
+	sensor->derived_channels = settings.derived_channels;
+	memcpy(sensor->programs, settings.programs, sizeof(sensor->programs));
+	sensor->next_on_stick = settings.next_on_stick;
+}
+
+int ReloadConfiguration(SHTW1_SENSOR table_of_sensors[], uint16_t * number_of_sensors, IOWKIT_HANDLE handles_table[], uint32_t stick_serial_numbers[], unsigned long number_of_devices)
+{
+	// called between sweeps: the new configuration is loaded and merged aside, then replaces the live table at once
+	static SHTW1_SENSOR reload_sensors[MAX_NUMBER_OF_SENSORS];
+	static uint8_t kept_sensors[MAX_NUMBER_OF_SENSORS]; // 1 = kept, 2 = kept and the I2C clock of its stick changed
+	NAME_POOL_CHUNK * live_names = sensor_names;
+	const I2C_CLOCK_SETTING * clock = NULL;
+	NAME_POOL_CHUNK * chunk = NULL;
+	uint16_t new_number_of_sensors = 0, sensors_iterator = 0;
+	uint16_t kept = 0, changed = 0, added = 0, bound = 0, removed = 0;
+	int32_t match = -1;
+	int settings_changed = 0;
+	unsigned long device = 0;
+	uint64_t trace_reload_start = TraceStart();
+	double reload_start = GetMonotonicTime();
+
+	sensor_names = NULL;
+	if (LoadConfiguration(reload_sensors, &new_number_of_sensors))
+	{
+		ReleaseConfiguration(reload_sensors, new_number_of_sensors);
+		sensor_names = live_names;
+		RebuildSensorIndex(table_of_sensors, * number_of_sensors);
+		printf("ERROR: Configuration not reloaded, measurements continue with the previous one.\n");
+		return -1;
+	}
+	memset(kept_sensors, 0x00, sizeof(kept_sensors));
+
+	// a sensor is the same physical sensor when its stick and I2C address did not change, even if it was renamed,
+	// a virtual sensor is the same when its name did not change
+	for (sensors_iterator = 0; sensors_iterator < * number_of_sensors; sensors_iterator++)
+	{
+		if (!table_of_sensors[sensors_iterator].stick_serial_number)
+		{
+			for (match = new_number_of_sensors - 1; match >= 0; match--)
+				if (!reload_sensors[match].stick_serial_number && strcmp(reload_sensors[match].name, table_of_sensors[sensors_iterator].name) == 0) break;
+		}
+		else for (match = FindStickSensors(reload_sensors, table_of_sensors[sensors_iterator].stick_serial_number); match >= 0; match = reload_sensors[match].next_on_stick)
+			if (reload_sensors[match].i2c_address == table_of_sensors[sensors_iterator].i2c_address) break;
+		if (match < 0)
+		{
+			printf("Removed sensor: %s\n", table_of_sensors[sensors_iterator].name);
+			free(table_of_sensors[sensors_iterator].history);
+			removed++;
+			continue;
+		}
+		if ((settings_changed = SensorSettingsChanged(&table_of_sensors[sensors_iterator], &reload_sensors[match])))
+		{
+			printf("Changed sensor: %s\n", reload_sensors[match].name);
+			changed++;
+		}
+		KeepSensorState(&reload_sensors[match], &table_of_sensors[sensors_iterator]);
+		kept_sensors[match] = (reload_sensors[match].usb_stick_handle && reload_sensors[match].i2c_clock_khz != table_of_sensors[sensors_iterator].i2c_clock_khz) ? 2 : 1;
+		// the periodic mode runs on the part itself, it is stopped or set up again with the new mode and period
+		if (settings_changed && reload_sensors[match].usb_stick_handle &&
+			(table_of_sensors[sensors_iterator].readout == READOUT_PERIODIC || reload_sensors[match].readout == READOUT_PERIODIC))
+			sensor_drivers[reload_sensors[match].driver].initialize(reload_sensors[match].usb_stick_handle, &reload_sensors[match]);
+		kept++;
+	}
+
+	// a new clock only takes effect with the next I2C enable, every stick with one is enabled again once, before its sensors are used
+	for (sensors_iterator = 0; sensors_iterator < new_number_of_sensors; sensors_iterator++)
+	{
+		if (kept_sensors[sensors_iterator] != 2) continue;
+		clock = FindI2cClock(IowKitGetProductId(reload_sensors[sensors_iterator].usb_stick_handle), reload_sensors[sensors_iterator].i2c_clock_khz);
+		if (clock == NULL) printf("ERROR: I2C clock %u[kHz] is not supported by USB STICK S/N (dec) %u, the default clock is used.\n",
+			reload_sensors[sensors_iterator].i2c_clock_khz, reload_sensors[sensors_iterator].stick_serial_number);
+		else printf("I2C clock of USB STICK S/N (dec) %u: %u[kHz]\n", reload_sensors[sensors_iterator].stick_serial_number, clock->clock_khz);
+		DisableI2c(reload_sensors[sensors_iterator].usb_stick_handle);
+		EnableI2c(reload_sensors[sensors_iterator].usb_stick_handle, reload_sensors[sensors_iterator].i2c_clock_khz);
+		for (match = FindStickSensors(reload_sensors, reload_sensors[sensors_iterator].stick_serial_number); match >= 0; match = reload_sensors[match].next_on_stick)
+			if (kept_sensors[match] == 2) kept_sensors[match] = 1;
+	}
+
+	// only the added sensors go through discovery, sticks are not enumerated again
+	for (sensors_iterator = 0; sensors_iterator < new_number_of_sensors; sensors_iterator++)
+	{
+		if (kept_sensors[sensors_iterator]) continue;
+		added++;
+		printf("Added sensor: %s\n", reload_sensors[sensors_iterator].name);
+		if (!reload_sensors[sensors_iterator].stick_serial_number) continue;
+		for (device = 0; device < number_of_devices; device++) if (stick_serial_numbers[device] == reload_sensors[sensors_iterator].stick_serial_number) break;
+		if (device == number_of_devices) printf("ERROR: Have not found USB STICK S/N (dec) %u, it was not connected at startup.\n", reload_sensors[sensors_iterator].stick_serial_number);
+		else if (!BindSensor(&reload_sensors[sensors_iterator], handles_table[device])) bound++;
+	}
+
+	// table positions are preserved, so the index built by LoadConfiguration stays valid for the live table
+	memcpy(table_of_sensors, reload_sensors, new_number_of_sensors * sizeof(SHTW1_SENSOR));
+	* number_of_sensors = new_number_of_sensors;
+	CalibrateSticks(table_of_sensors, new_number_of_sensors); // probes only the sticks without a kept sensor
+	AllocateHistories(table_of_sensors, new_number_of_sensors);
+	sweep_workers.layout_changed = 1;
+	while ((chunk = live_names) != NULL)
+	{
+		live_names = chunk->next;
+		free(chunk);
+	}
+
+	TraceEvent(TRACE_RELOAD, trace_reload_start, new_number_of_sensors);
+	PROBE3(configuration_reload, kept, added, removed);
+	printf("Configuration reloaded in %.2f[ms]: %u sensors kept (%u changed), %u added (%u bound), %u removed.\n\n",
+		(GetMonotonicTime() - reload_start) * 1000, kept, changed, added, bound, removed);
+	return 0;
+}
+
+int WatchConfiguration(void)
+{
+	// inotify on the directory, editors usually replace the file instead of writing into it
+	char directory[MAX_FILE_PATH_LENGTH];
+	char * slash = NULL;
+	int inotify_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotify_descriptor < 0) return -1;
+	snprintf(directory, sizeof(directory), "%s", options.configuration_path);
+	slash = strrchr(directory, '/');
+	if (slash == NULL) strcpy(directory, ".");
+	else if (slash == directory) slash[1] = 0;
+	else * slash = 0;
+	if (inotify_add_watch(inotify_descriptor, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		printf("ERROR: Could not watch the configuration file, reload it with SIGHUP.\n");
+		close(inotify_descriptor);
+		return -1;
+	}
+	return inotify_descriptor;
+}
+
+int ConfigurationChanged(int inotify_descriptor)
+{
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const char * file_name = strrchr(options.configuration_path, '/') ? strrchr(options.configuration_path, '/') + 1 : options.configuration_path;
+	struct inotify_event * event = NULL;
+	ssize_t length = 0;
+	char * position = NULL;
+	int changed = 0;
+
+	if (inotify_descriptor < 0) return 0;
+	while ((length = read(inotify_descriptor, buffer, sizeof(buffer))) > 0)
+	{
+		for (position = buffer; position < buffer + length; position += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event *) position;
+			if (event->len && strcmp(event->name, file_name) == 0) changed = 1;
+		}
+	}
+	return changed;
+}
+
+int NotifyServiceManager(const char * state)
+{
+	// sd_notify() protocol without libsystemd: one datagram to the socket in NOTIFY_SOCKET, nothing to do outside systemd
+	static int notify_descriptor = -1;
+	static struct sockaddr_un notify_address;
+	static socklen_t notify_address_length = 0;
+	const char * socket_path = NULL;
+
+	if (notify_descriptor < 0)
+	{
+		socket_path = getenv("NOTIFY_SOCKET");
+		if (socket_path == NULL || (socket_path[0] != '/' && socket_path[0] != '@') || strlen(socket_path) >= sizeof(notify_address.sun_path)) return 0;
+		notify_descriptor = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (notify_descriptor < 0) return -1;
+		memset(&notify_address, 0, sizeof(notify_address));
+		notify_address.sun_family = AF_UNIX;
+		memcpy(notify_address.sun_path, socket_path, strlen(socket_path));
+		if (socket_path[0] == '@') notify_address.sun_path[0] = 0; // abstract socket
+		notify_address_length = offsetof(struct sockaddr_un, sun_path) + strlen(socket_path);
+	}
+	if (sendto(notify_descriptor, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *)&notify_address, notify_address_length) < 0) return -1;
+	return 0;
+}
+
+double GetWatchdogInterval(void)
+{
+	// heartbeat period for WatchdogSec= of the service, in seconds, 0 = no watchdog
+	const char * watchdog_usec = getenv("WATCHDOG_USEC");
+	const char * watchdog_pid = getenv("WATCHDOG_PID");
+
+	if (watchdog_usec == NULL) return 0.0;
+	if (watchdog_pid != NULL && strtoul(watchdog_pid, NULL, 10) != (unsigned long)getpid()) return 0.0;
+	return strtod(watchdog_usec, NULL) / 1000000.0 / WATCHDOG_HEARTBEAT_DIVIDER;
+}
+
+int OpenSignalDescriptor(void)
+{
+	// the signals are blocked and read between sweeps, they never interrupt an I2C transaction
+	sigset_t mask;
+	int signal_descriptor = -1;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGUSR1);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) == 0) signal_descriptor = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_descriptor < 0)
+	{
+		sigprocmask(SIG_UNBLOCK, &mask, NULL);
+		printf("ERROR: Could not open a signalfd, signals are handled asynchronously.\n");
+	}
+	return signal_descriptor;
+}
+
+void HandleSignals(int signal_descriptor)
+{
+	struct signalfd_siginfo signal_info;
+
+	while (read(signal_descriptor, &signal_info, sizeof(signal_info)) == sizeof(signal_info))
+	{
+		switch (signal_info.ssi_signo)
+		{
+			case SIGINT:
+			case SIGTERM: infinite_loop_control = 0; break;
+			case SIGHUP: reload_requested = 1; break;
+			case SIGUSR1: trace_dump_requested = 1; break;
+		}
+	}
+}
+
+void CloseControlClient(CONTROL_CLIENT * client)
+{
+	close(client->descriptor);
+	client->descriptor = -1;
+	client->input_length = 0;
+	free(client->output);
+	client->output = NULL;
+}
+
+int OpenControlSocket(const char * path)
+{
+	// '@' at the start of the path = abstract socket, a socket file left by a previous run is replaced
+	struct sockaddr_un address;
+	uint8_t client = 0;
+	mode_t mask;
+	int bound = 0;
+
+	for (client = 0; client < CONTROL_MAX_CLIENTS; client++) control_socket.clients[client].descriptor = -1;
+	if (!path[0] || strlen(path) >= sizeof(address.sun_path))
+	{
+		printf("ERROR: Control socket path is empty or longer than %u characters: %s\n", (unsigned)sizeof(address.sun_path) - 1, path);
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path, strlen(path));
+	if (path[0] == '@') address.sun_path[0] = 0;
+	else unlink(path);
+
+	// a socket file is created for the owner only, an abstract socket has no permissions and relies on the peer check when accepted
+	control_socket.descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	mask = umask(0177);
+	bound = control_socket.descriptor >= 0 && bind(control_socket.descriptor, (struct sockaddr *)&address, offsetof(struct sockaddr_un, sun_path) + strlen(path)) == 0;
+	umask(mask);
+	if (!bound || listen(control_socket.descriptor, CONTROL_MAX_CLIENTS))
+	{
+		printf("ERROR: Could not open the control socket %s: %s\n", path, strerror(errno));
+		if (control_socket.descriptor >= 0) close(control_socket.descriptor);
+		control_socket.descriptor = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void CloseControlSocket(const char * path, double deadline)
+{
+	uint8_t client = 0;
+
+	if (control_socket.descriptor < 0) return;
+	for (client = 0; client < CONTROL_MAX_CLIENTS; client++)
+		if (control_socket.clients[client].descriptor >= 0) CloseControlClient(&control_socket.clients[client]);
+	close(control_socket.descriptor);
+	control_socket.descriptor = -1;
+	if (path[0] != '@') unlink(path);
+	if (ClosePlotProcess(&control_socket.snapshot, deadline)) printf("ERROR: Plot snapshot process did not quit, killed.\n");
+}
+
+SHTW1_SENSOR * FindSensorByName(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors, const char * name)
+{
+	// linear, the name index lives only while the configuration is loaded
+	while (number_of_sensors--) if (strcmp(sensors_table[number_of_sensors].name, name) == 0) return &sensors_table[number_of_sensors];
+	return NULL;
+}
+
+int StartPlotSnapshot(const char * path, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// the histories of the plotted sensors drawn into a PNG file by a separate plot process, reaped by ServeControlSocket when done
+	FILE * gnuplot = NULL;
+
+	if (OpenPlotProcess(&control_socket.snapshot, options.plot_command)) return -1;
+	gnuplot = control_socket.snapshot.pipe;
+	fprintf(gnuplot, "set terminal pngcairo size 800,900\n");
+	fprintf(gnuplot, "set output '%s'\n", path);
+	fprintf(gnuplot, "set multiplot layout 3,1 rowsfirst\n");
+	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
+	fprintf(gnuplot, "set title 'Temperature plot.'\n");
+	fprintf(gnuplot, "set ylabel 'Temperature [*C]' rotate\n");
+	PlotSensorsHistory(gnuplot, sensors_table, number_of_sensors, 0);
+	fprintf(gnuplot, "set title 'Relative Humidity plot.'\n");
+	fprintf(gnuplot, "set ylabel 'RH[%%]' rotate\n");
+	PlotSensorsHistory(gnuplot, sensors_table, number_of_sensors, 1);
+	fprintf(gnuplot, "set title 'Dew Point plot.'\n");
+	fprintf(gnuplot, "set ylabel 'Dew_Point[*C]' rotate\n");
+	PlotSensorsHistory(gnuplot, sensors_table, number_of_sensors, 2);
+	fprintf(gnuplot, "unset multiplot\n");
+	fprintf(gnuplot, "set output\n");
+	fprintf(gnuplot, "quit\n");
+	fclose(gnuplot);
+	control_socket.snapshot.pipe = NULL;
+	return 0;
+}
+
+void ExecuteControlCommand(FILE * reply, char * line, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// a reply ends with an "OK" line, or is a single "ERROR: ..." line
+	static HISTORY_SAMPLE samples[HISTORY_RAW_SAMPLES];
+	char * arguments[3] = {NULL, NULL, NULL};
+	char * save_position = NULL;
+	char * end = NULL;
+	char option[CONTROL_LINE_LENGTH + 8];
+	char snapshot_path[MAX_FILE_PATH_LENGTH];
+	const char * error = NULL;
+	SHTW1_SENSOR * sensor = NULL;
+	SHTW1_SENSOR settings;
+	unsigned long count = 0;
+	uint32_t number_of_samples = 0, sample = 0;
+	uint8_t command = 0, argument = 0;
+
+	for (argument = 0; argument < 3; argument++) arguments[argument] = strtok_r(argument ? NULL : line, " \t\r", &save_position);
+	if (arguments[0] == NULL) arguments[0] = "help";
+	for (command = 0; command < NUMBER_OF_CONTROL_COMMANDS; command++) if (strcmp(arguments[0], control_command_names[command]) == 0) break;
+	if (command == NUMBER_OF_CONTROL_COMMANDS)
+	{
+		fprintf(reply, "ERROR: unknown command %s, \"help\" lists the commands\n", arguments[0]);
+		return;
+	}
+	if (control_command_arguments[command] && arguments[control_command_arguments[command]] == NULL)
+	{
+		fprintf(reply, "ERROR: usage: %s\n", control_command_usages[command]);
+		return;
+	}
+	if (command == CONTROL_LAST || command == CONTROL_RESET || command == CONTROL_RATE)
+	{
+		sensor = FindSensorByName(sensors_table, number_of_sensors, arguments[1]);
+		if (sensor == NULL)
+		{
+			fprintf(reply, "ERROR: unknown sensor %s\n", arguments[1]);
+			return;
+		}
+	}
+
+	switch (command)
+	{
+		case CONTROL_HELP:
+			for (command = 0; command < NUMBER_OF_CONTROL_COMMANDS; command++) fprintf(reply, "%s\n", control_command_usages[command]);
+			fprintf(reply, "a changed rate is kept until the configuration is reloaded\n");
+			break;
+		case CONTROL_LIST:
+			fprintf(reply, "%-20s %10s %7s %-12s %16s %10s %s\n", "sensor", "stick", "address", "driver", "readout", "period[ms]", "state");
+			for (sensor = sensors_table; sensor < sensors_table + number_of_sensors; sensor++)
+			{
+				if (!sensor->stick_serial_number) fprintf(reply, "%-20s %10s %7s %-12s %16s %10s %s\n", sensor->name, VIRTUAL_STICK, "-", "-", "-", "-", "virtual");
+				else fprintf(reply, "%-20s %10u    0x%02X %-12s %16s %10u %s\n", sensor->name, sensor->stick_serial_number, sensor->i2c_address,
+					sensor_drivers[sensor->driver].name, readout_names[sensor->readout], GetSamplePeriod(sensor), sensor->usb_stick_handle ? "bound" : "not found");
+			}
+			break;
+		case CONTROL_LAST:
+			count = CONTROL_DEFAULT_SAMPLES;
+			if (arguments[2] != NULL) count = strtoul(arguments[2], &end, 10);
+			if ((arguments[2] != NULL && (* end || * arguments[2] == '-')) || !count || count > HISTORY_RAW_SAMPLES)
+			{
+				fprintf(reply, "ERROR: number of samples must be from 1 to %u\n", HISTORY_RAW_SAMPLES);
+				return;
+			}
+			number_of_samples = QueryHistoryLast(sensor, (uint32_t)count, samples);
+			fprintf(reply, RECORD_HEADER);
+			for (sample = 0; sample < number_of_samples; sample++)
+				fprintf(reply, RECORD_LINE_FORMAT, GetRecordTime(samples[sample].time), sensor->name, samples[sample].values[0], samples[sample].values[1], samples[sample].values[2]);
+			break;
+		case CONTROL_STATS:
+			fprintf(reply, "measuring for %.1f[s], %u samples, %u failed sweeps, %u recoveries, %u USB stalls\n",
+				bench_statistics.measurement_start > 0 ? GetMonotonicTime() - bench_statistics.measurement_start : 0.0, bench_statistics.number_of_samples,
+				bench_statistics.number_of_failed_sweeps, bench_statistics.number_of_recoveries, usb_watchdog.stalls);
+			PrintSweepTiming(reply);
+			PrintTimingAnalysis(reply, sensors_table, number_of_sensors);
+			break;
+		case CONTROL_HEALTH:
+			PrintSensorsHealth(reply, sensors_table, number_of_sensors);
+			break;
+		case CONTROL_RESET:
+			if (!sensor->usb_stick_handle)
+			{
+				fprintf(reply, "ERROR: sensor %s is not bound\n", sensor->name);
+				return;
+			}
+			if (sensor_drivers[sensor->driver].initialize(sensor->usb_stick_handle, sensor))
+			{
+				fprintf(reply, "ERROR: sensor %s did not answer after the soft reset\n", sensor->name);
+				return;
+			}
+			printf("Sensor %s: soft reset from the control socket\n", sensor->name);
+			break;
+		case CONTROL_RATE:
+			// validated as the period key of the configuration
+			settings = * sensor;
+			snprintf(option, sizeof(option), "period=%s", arguments[2]);
+			error = ParseSensorOption(&settings, option, &end, NULL);
+			if (error)
+			{
+				fprintf(reply, "ERROR: %s\n", error);
+				return;
+			}
+			sensor->period_ms = settings.period_ms;
+			// the periodic mode runs on the part itself, it is set up again with the new period
+			if (sensor->usb_stick_handle && sensor->readout == READOUT_PERIODIC && sensor_drivers[sensor->driver].initialize(sensor->usb_stick_handle, sensor))
+			{
+				fprintf(reply, "ERROR: sensor %s did not answer with the new period\n", sensor->name);
+				return;
+			}
+			printf("Sensor %s: sample period %u[ms] from the control socket\n", sensor->name, sensor->period_ms);
+			break;
+		case CONTROL_PLOT:
+			// the snapshot is written to the records directory only, a path or a gnuplot '|command' output never reaches the plot process
+			if (!IsPlainName(arguments[1], strlen(arguments[1])) || arguments[1][0] == '.')
+			{
+				fprintf(reply, "ERROR: plot file name may contain only letters, digits, '_', '.' and '-' and may not start with '.'\n");
+				return;
+			}
+			if (snprintf(snapshot_path, MAX_FILE_PATH_LENGTH, "%s/%s", options.records_directory, arguments[1]) >= MAX_FILE_PATH_LENGTH)
+			{
+				fprintf(reply, "ERROR: plot file path in the records directory is longer than %u characters\n", MAX_FILE_PATH_LENGTH - 1);
+				return;
+			}
+			if (control_socket.snapshot.pid > 0)
+			{
+				fprintf(reply, "ERROR: previous plot snapshot is still being drawn\n");
+				return;
+			}
+			if (StartPlotSnapshot(snapshot_path, sensors_table, number_of_sensors))
+			{
+				fprintf(reply, "ERROR: could not start the plot command\n");
+				return;
+			}
+			fprintf(reply, "%s\n", snapshot_path);
+			break;
+	}
+	fprintf(reply, "OK\n");
+}
+
+void ServeControlSocket(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// called from the event loop, every socket is non-blocking: a client gets at most one pending reply, it holds the replies to all
+	// complete command lines read so far, poll() would not wake up again for lines already in the input
+	CONTROL_CLIENT * client = NULL;
+	uint8_t client_index = 0;
+	int descriptor = -1;
+	ssize_t length = 0;
+	char * line_end = NULL;
+	FILE * reply = NULL;
+	struct ucred credentials;
+	socklen_t credentials_length;
+
+	if (control_socket.descriptor < 0) return;
+	if (control_socket.snapshot.pid > 0 && waitpid(control_socket.snapshot.pid, NULL, WNOHANG) != 0) control_socket.snapshot.pid = -1;
+
+	while ((descriptor = accept4(control_socket.descriptor, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		credentials_length = sizeof(credentials);
+		if (getsockopt(descriptor, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) || (credentials.uid != geteuid() && credentials.uid != 0))
+		{
+			send(descriptor, CONTROL_DENIED_REPLY, strlen(CONTROL_DENIED_REPLY), MSG_NOSIGNAL | MSG_DONTWAIT);
+			close(descriptor);
+			continue;
+		}
+		for (client_index = 0; client_index < CONTROL_MAX_CLIENTS && control_socket.clients[client_index].descriptor >= 0; client_index++);
+		if (client_index == CONTROL_MAX_CLIENTS)
+		{
+			send(descriptor, CONTROL_BUSY_REPLY, strlen(CONTROL_BUSY_REPLY), MSG_NOSIGNAL | MSG_DONTWAIT);
+			close(descriptor);
+			continue;
+		}
+		control_socket.clients[client_index].descriptor = descriptor;
+	}
+
+	for (client_index = 0; client_index < CONTROL_MAX_CLIENTS; client_index++)
+	{
+		client = &control_socket.clients[client_index];
+		if (client->descriptor < 0) continue;
+		if (client->output)
+		{
+			length = send(client->descriptor, client->output + client->output_sent, client->output_length - client->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				CloseControlClient(client);
+				continue;
+			}
+			if (length > 0) client->output_sent += (size_t)length;
+			if (client->output_sent < client->output_length) continue;
+			free(client->output);
+			client->output = NULL;
+		}
+
+		if (client->input_length < CONTROL_LINE_LENGTH)
+		{
+			length = recv(client->descriptor, client->input + client->input_length, CONTROL_LINE_LENGTH - client->input_length, MSG_DONTWAIT);
+			if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+			{
+				CloseControlClient(client);
+				continue;
+			}
+			if (length > 0) client->input_length += (size_t)length;
+		}
+		line_end = memchr(client->input, '\n', client->input_length);
+		if (line_end == NULL && client->input_length < CONTROL_LINE_LENGTH) continue;
+
+		reply = open_memstream(&client->output, &client->output_length);
+		if (reply == NULL)
+		{
+			CloseControlClient(client);
+			continue;
+		}
+		do
+		{
+			if (line_end == NULL)
+			{
+				fprintf(reply, "ERROR: command longer than %u characters\n", CONTROL_LINE_LENGTH - 1);
+				client->input_length = 0;
+			}
+			else
+			{
+				* line_end = 0;
+				ExecuteControlCommand(reply, client->input, sensors_table, number_of_sensors);
+				client->input_length -= (size_t)(line_end + 1 - client->input);
+				memmove(client->input, line_end + 1, client->input_length);
+			}
+		}
+		while (client->input_length && (line_end = memchr(client->input, '\n', client->input_length)) != NULL);
+		fclose(reply);
+		client->output_sent = 0;
+	}
+}
+
+void WaitForEvents(int signal_descriptor, int inotify_descriptor, double wake_time)
+{
+	// sleeps until wake_time (CLOCK_MONOTONIC), a signal, a change of the configuration file or control socket traffic, negative descriptors are skipped
+	struct pollfd descriptors[3 + CONTROL_MAX_CLIENTS] = { { .fd = signal_descriptor, .events = POLLIN }, { .fd = inotify_descriptor, .events = POLLIN },
+		{ .fd = control_socket.descriptor, .events = POLLIN } };
+	nfds_t number_of_descriptors = 3;
+	uint8_t client = 0;
+	double remaining = wake_time - GetMonotonicTime();
+
+	if (remaining <= 0) return;
+	for (client = 0; client < CONTROL_MAX_CLIENTS && control_socket.descriptor >= 0; client++)
+	{
+		if (control_socket.clients[client].descriptor < 0) continue;
+		descriptors[number_of_descriptors].fd = control_socket.clients[client].descriptor;
+		descriptors[number_of_descriptors++].events = control_socket.clients[client].output ? POLLOUT : POLLIN;
+	}
+	if (poll(descriptors, number_of_descriptors, (int)ceil(remaining * 1000)) > 0 && (descriptors[0].revents & POLLIN)) HandleSignals(signal_descriptor);
+}
+
+int ReopenSticks(IOWKIT_HANDLE ** handles_table, uint32_t ** stick_serial_numbers, unsigned long * number_of_devices, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// last escalation step after a stall: iowkit closes all sticks at once, so every stick is opened and every sensor bound again
+	uint64_t trace_reopen_start = TraceStart();
+	double reopen_start = GetMonotonicTime(), reopen_time;
+	unsigned long device_counter;
+	uint16_t sensors_iterator;
+	uint16_t bound_sensors = 0;
+	IOWKIT_HANDLE handle;
+
+	printf("Re-opening %lu USB Sticks after a stall.\n", *number_of_devices);
+	pthread_mutex_lock(&usb_watchdog.mutex); // no cancel can reach a closed handle
+	if (*number_of_devices) IowKitCloseDevice((*handles_table)[0]);
+	handle = IowKitOpenDevice();
+	*number_of_devices = handle ? IowKitGetNumDevs() : 0;
+	*handles_table = realloc(*handles_table, (*number_of_devices ? *number_of_devices : 1) * sizeof(IOWKIT_HANDLE));
+	*stick_serial_numbers = realloc(*stick_serial_numbers, (*number_of_devices ? *number_of_devices : 1) * sizeof(uint32_t));
+	(*handles_table)[0] = handle;
+	for (device_counter = 1; device_counter < *number_of_devices; device_counter++) (*handles_table)[device_counter] = IowKitGetDeviceHandle(device_counter + 1);
+	pthread_mutex_unlock(&usb_watchdog.mutex);
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++) sensors_table[sensors_iterator].usb_stick_handle = NULL;
+	if (!*number_of_devices)
+	{
+		printf("ERROR: No USB Stick found after the re-open, trying again after the next sweep.\n");
+		return -1;
+	}
+	usb_watchdog.reopen_requested = 0;
+	InitializeSticksAndSensors(*handles_table, *stick_serial_numbers, *number_of_devices, sensors_table, number_of_sensors);
+	CheckSensorsPresence(sensors_table, number_of_sensors);
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++) if (sensors_table[sensors_iterator].usb_stick_handle) bound_sensors++;
+
+	reopen_time = GetMonotonicTime() - reopen_start;
+	usb_watchdog.reopens++;
+	usb_watchdog.reopen_time += reopen_time;
+	if (reopen_time > usb_watchdog.max_reopen_time) usb_watchdog.max_reopen_time = reopen_time;
+	bench_statistics.number_of_recoveries++;
+	TraceEvent(TRACE_STICKS_REOPEN, trace_reopen_start, (uint32_t)*number_of_devices);
+	PROBE2(sticks_reopen, (uint32_t)*number_of_devices, bound_sensors);
+	printf("Re-opened %lu USB Sticks in %.2f[ms].\n", *number_of_devices, reopen_time * 1000);
+	return 0;
+}
+
+int ShutdownAcquisition(RECORD_STORE * records, PLOT_PROCESS plots[], IOWKIT_HANDLE handles_table[], unsigned long number_of_devices,
+	SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	// drains the sinks and releases the sticks within options.shutdown_deadline_ms, returns -1 when something was left behind
+	double shutdown_start = GetMonotonicTime();
+	double deadline = shutdown_start + options.shutdown_deadline_ms / 1000.0;
+	int pending_records = 0, synced = 1; // nothing to sync without a result file
+	long records_size = 0;
+	uint8_t plot = 0, plots_closed = 0, plots_killed = 0;
+	unsigned long device = 0, sticks_disabled = 0;
+
+	// samples of a failed last sweep are still waiting for their records
+	if (records->file)
+	{
+		pending_records = WriteResultRecords(records, sensors_table, number_of_sensors);
+		bench_statistics.number_of_samples += pending_records;
+		records_size = ftell(records->file);
+		synced = (CloseRecordStore(records) == 0);
+	}
+
+	// every stick gets its I2C disabled, the ones after the deadline are left to the library close
+	for (device = 0; device < number_of_devices && GetMonotonicTime() < deadline; device++)
+	{
+		IowKitSetWriteTimeout(handles_table[device], I2C_TIMEOUT_MS);
+		DisableI2c(handles_table[device]);
+		sticks_disabled++;
+	}
+	if (number_of_devices) IowKitCloseDevice(handles_table[0]); // closes all sticks
+
+	StopPlotWriter(deadline);
+	for (plot = 0; plot < NUMBER_OF_PLOTS; plot++)
+	{
+		if (plots[plot].pid <= 0) continue;
+		if (ClosePlotProcess(&plots[plot], deadline)) plots_killed++;
+		else plots_closed++;
+	}
+
+	printf("\nShutdown in %.2f[ms] (deadline %u[ms]):\n", (GetMonotonicTime() - shutdown_start) * 1000, options.shutdown_deadline_ms);
+	printf("   records: %d pending samples written, %ld bytes in %u blocks %s\n", pending_records, records_size, records->sequence, synced ? "synced to disk" : "NOT synced to disk");
+	printf("   plots:   %u closed, %u killed, %u updates dropped while the previous one was written\n", plots_closed, plots_killed, plot_writer.skipped_frames);
+	printf("   sticks:  %lu of %lu I2C disabled, all closed\n", sticks_disabled, number_of_devices);
+	return !synced || plots_killed || sticks_disabled < number_of_devices ? -1 : 0;
+}
+
+double GetPercentile(double sorted_values[], uint32_t number_of_values, double percentile)
+{
+	// nearest-rank percentile of an ascending table
+	uint32_t rank;
+	if (!number_of_values) return 0.0;
+	rank = (uint32_t)ceil(percentile / 100.0 * number_of_values);
+	if (rank < 1) rank = 1;
+	return sorted_values[rank - 1];
+}
+
+void AddBenchSweep(double sweep_time)
+{
+	if (bench_statistics.number_of_sweeps == bench_statistics.sweep_latencies_size)
+	{
+		bench_statistics.sweep_latencies_size = bench_statistics.sweep_latencies_size ? 2 * bench_statistics.sweep_latencies_size : 1024;
+		bench_statistics.sweep_latencies = realloc(bench_statistics.sweep_latencies, bench_statistics.sweep_latencies_size * sizeof(double));
+	}
+	bench_statistics.sweep_latencies[bench_statistics.number_of_sweeps++] = sweep_time;
+}
+
+void ProbeWakeupLatency(double latencies[])
+{
+	// the oversleep of short sleeps, this is how late the acquisition thread wakes up for a sweep on a loaded PC
+	double start;
+	uint32_t sleeps_iterator;
+
+	for (sleeps_iterator = 0; sleeps_iterator < WAKEUP_PROBE_SLEEPS; sleeps_iterator++)
+	{
+		start = GetMonotonicTime();
+		usleep(WAKEUP_PROBE_SLEEP_US);
+		latencies[sleeps_iterator] = GetMonotonicTime() - start - WAKEUP_PROBE_SLEEP_US / 1e6;
+	}
+	qsort(latencies, WAKEUP_PROBE_SLEEPS, sizeof(double), CompareDoubles);
+}
+
+void PrintWakeupLatency(const char * label, double latencies[])
+{
+	printf("   %-28s p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", label, GetPercentile(latencies, WAKEUP_PROBE_SLEEPS, 50) * 1000,
+		GetPercentile(latencies, WAKEUP_PROBE_SLEEPS, 90) * 1000, GetPercentile(latencies, WAKEUP_PROBE_SLEEPS, 99) * 1000,
+		latencies[WAKEUP_PROBE_SLEEPS - 1] * 1000);
+}
+
+int SetRealtimeScheduling(void)
+{
+	// the calling (acquisition) thread is switched, the sweep workers started later take its policy and priority but run on all CPUs
+	// of the process (StartSweepWorkers), the USB watchdog, the plot writer and the plot processes keep the normal priority
+	struct sched_param parameters = { .sched_priority = options.realtime_priority };
+	cpu_set_t cpus;
+	int result = 0;
+
+	sched_getaffinity(0, sizeof(sweep_workers.cpus), &sweep_workers.cpus);
+	if (!options.realtime_priority && options.cpu < 0 && !options.lock_memory) return 0;
+
+	printf("\n-- Real-time scheduling -----------------------------------\n");
+	ProbeWakeupLatency(bench_statistics.wakeup_latencies[0]);
+	if (options.lock_memory)
+	{
+		if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		{
+			printf("ERROR: Could not lock the memory: %s\n", strerror(errno));
+			result = -1;
+		}
+		else printf("Memory locked.\n");
+	}
+	if (options.cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(options.cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		{
+			printf("ERROR: Could not pin the acquisition thread to CPU %i: %s\n", options.cpu, strerror(errno));
+			result = -1;
+		}
+		else printf("Acquisition thread pinned to CPU %i.\n", options.cpu);
+	}
+	if (options.realtime_priority)
+	{
+		// forked plot processes would not inherit the real-time policy
+		if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &parameters))
+		{
+			printf("ERROR: Could not set SCHED_FIFO priority %i: %s\n", options.realtime_priority, strerror(errno));
+			result = -1;
+		}
+		else printf("Acquisition thread runs under SCHED_FIFO with priority %i.\n", options.realtime_priority);
+	}
+	ProbeWakeupLatency(bench_statistics.wakeup_latencies[1]);
+	bench_statistics.realtime_probed = 1;
+
+	printf("Wake-up latency of %u sleeps of %u[us], [ms]:\n", WAKEUP_PROBE_SLEEPS, WAKEUP_PROBE_SLEEP_US);
+	PrintWakeupLatency("before:", bench_statistics.wakeup_latencies[0]);
+	PrintWakeupLatency("after:", bench_statistics.wakeup_latencies[1]);
+	printf("----------------------------------------------------------\n\n");
+	return result;
+}
+
+int WriteBenchReport(char * report_path, SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors)
+{
+	struct rusage usage;
+	uint32_t health_counters[NUMBER_OF_HEALTH_EVENTS] = {0}, recoveries[NUMBER_OF_RECOVERY_ACTIONS] = {0};
+	uint32_t failed_recoveries = 0, recovered = 0, saved_samples = 0;
+	double action_time = 0.0, max_action_time = 0.0, recovered_time = 0.0, max_recovered_time = 0.0;
+	uint16_t sensors_iterator = 0;
+	uint8_t event = 0, probe;
+	double measurement_time = bench_statistics.measurement_stop - bench_statistics.measurement_start;
+	double user_time, system_time, latency_sum = 0.0;
+	uint32_t sweeps_iterator = 0;
+	FILE * report_file = fopen(report_path, "w");
+
+	if (report_file == NULL)
+	{
+		printf("ERROR: Could not create benchmark report file: %s\n", report_path);
+		return -1;
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+	user_time = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec/1000000;
+	system_time = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec/1000000;
+
+	for (sweeps_iterator = 0; sweeps_iterator < bench_statistics.number_of_sweeps; sweeps_iterator++) latency_sum += bench_statistics.sweep_latencies[sweeps_iterator];
+	qsort(bench_statistics.sweep_latencies, bench_statistics.number_of_sweeps, sizeof(double), CompareDoubles);
+
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
+	{
+		SENSOR_HEALTH * health = &sensors_table[sensors_iterator].health;
+		for (event = 0; event < NUMBER_OF_HEALTH_EVENTS; event++) health_counters[event] += health->counters[event];
+		recoveries[RECOVERY_SOFT_RESET] += health->recoveries[RECOVERY_SOFT_RESET];
+		recoveries[RECOVERY_BUS_REENABLE] += health->recoveries[RECOVERY_BUS_REENABLE];
+		failed_recoveries += health->failed_recoveries;
+		recovered += health->recovered;
+		saved_samples += sensors_table[sensors_iterator].adaptive.saved_samples;
+		action_time += health->action_time;
+		recovered_time += health->recovered_time;
+		if (health->max_action_time > max_action_time) max_action_time = health->max_action_time;
+		if (health->max_recovered_time > max_recovered_time) max_recovered_time = health->max_recovered_time;
+	}
+
+	fprintf(report_file, "{\"configured_sensors\": %u, \"bound_sensors\": %u, ", number_of_sensors, bench_statistics.number_of_bound_sensors);
+	fprintf(report_file, "\"worker_layout\": \"%s\", \"sweep_workers\": %u, ", worker_layout_names[options.worker_layout], sweep_workers.number_of_workers);
+	fprintf(report_file, "\"measurement_delay_ms\": %u, \"sweeps\": %u, \"failed_sweeps\": %u, \"samples\": %u, ", options.measurement_delay_ms, bench_statistics.number_of_sweeps, bench_statistics.number_of_failed_sweeps, bench_statistics.number_of_samples);
+	fprintf(report_file, "\"configuration_load_ms\": %.3f, \"discovery_ms\": %.3f, \"measurement_s\": %.3f, ", bench_statistics.configuration_load_time * 1000, bench_statistics.discovery_time * 1000, measurement_time);
+	fprintf(report_file, "\"samples_per_second\": %.1f, \"adaptive_saved_samples\": %u, ", measurement_time > 0 ? bench_statistics.number_of_samples / measurement_time : 0.0, saved_samples);
+	fprintf(report_file, "\"sweep_latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, ",
+		bench_statistics.number_of_sweeps ? latency_sum / bench_statistics.number_of_sweeps * 1000 : 0.0,
+		GetPercentile(bench_statistics.sweep_latencies, bench_statistics.number_of_sweeps, 50) * 1000,
+		GetPercentile(bench_statistics.sweep_latencies, bench_statistics.number_of_sweeps, 90) * 1000,
+		GetPercentile(bench_statistics.sweep_latencies, bench_statistics.number_of_sweeps, 99) * 1000,
+		GetPercentile(bench_statistics.sweep_latencies, bench_statistics.number_of_sweeps, 100) * 1000);
+	fprintf(report_file, "\"sample_jitter_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, ", GetJitterPercentile(50) * 1000,
+		GetJitterPercentile(90) * 1000, GetJitterPercentile(99) * 1000, timing_analyzer.max_jitter * 1000);
+	fprintf(report_file, "\"timestamp_uncertainty_ms\": {\"mean\": %.3f, \"max\": %.3f}, ",
+		timing_analyzer.number_of_samples ? timing_analyzer.uncertainty_sum / timing_analyzer.number_of_samples * 1000 : 0.0, timing_analyzer.max_uncertainty * 1000);
+	fprintf(report_file, "\"health\": {");
+	for (event = 0; event < NUMBER_OF_HEALTH_EVENTS; event++) fprintf(report_file, "\"%s\": %u, ", health_event_names[event], health_counters[event]);
+	fprintf(report_file, "\"soft_resets\": %u, \"bus_reenables\": %u, \"failed_recoveries\": %u, \"recovery_action_ms\": {\"total\": %.3f, \"max\": %.3f}, ",
+		recoveries[RECOVERY_SOFT_RESET], recoveries[RECOVERY_BUS_REENABLE], failed_recoveries, action_time * 1000, max_action_time * 1000);
+	fprintf(report_file, "\"time_to_recover_ms\": {\"mean\": %.3f, \"max\": %.3f}, ", recovered ? recovered_time / recovered * 1000 : 0.0, max_recovered_time * 1000);
+	fprintf(report_file, "\"usb_stall_max_ms\": %.3f, \"sticks_reopens\": %u, \"sticks_reopen_ms\": {\"mean\": %.3f, \"max\": %.3f}}, ", usb_watchdog.max_stall_time * 1000,
+		usb_watchdog.reopens, usb_watchdog.reopens ? usb_watchdog.reopen_time / usb_watchdog.reopens * 1000 : 0.0, usb_watchdog.max_reopen_time * 1000);
+	if (bench_statistics.realtime_probed)
+	{
+		fprintf(report_file, "\"realtime\": {\"priority\": %i, \"cpu\": %i, \"mlock\": %i, ", options.realtime_priority, options.cpu, options.lock_memory);
+		for (probe = 0; probe < 2; probe++)
+			fprintf(report_file, "\"wakeup_latency_%s_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s", probe ? "after" : "before",
+				GetPercentile(bench_statistics.wakeup_latencies[probe], WAKEUP_PROBE_SLEEPS, 50) * 1000,
+				GetPercentile(bench_statistics.wakeup_latencies[probe], WAKEUP_PROBE_SLEEPS, 99) * 1000,
+				bench_statistics.wakeup_latencies[probe][WAKEUP_PROBE_SLEEPS - 1] * 1000, probe ? "}, " : ", ");
+	}
+	fprintf(report_file, "\"cpu\": {\"user_s\": %.3f, \"system_s\": %.3f, \"utilization\": %.3f}, \"max_rss_kb\": %ld}\n",
+		user_time, system_time, measurement_time > 0 ? (user_time + system_time) / measurement_time : 0.0, usage.ru_maxrss);
+
+	fclose(report_file);
+	return 0;
+}
 
-	//printf("S/N (hex) of the io-warrior device: %s\n", serial_number_string);
+// Microbenchmarks of the per-sample CPU cost. Every kernel is timed call by call on a single input ("single", clock overhead
+// subtracted) and in runs over MICROBENCH_BATCH_SIZE distinct inputs ("batch", time divided by the number of inputs).
 
-	return serial_number_int;
-}
+typedef struct MICROBENCH_KERNEL
+{
+	const char * name;
+	void (*run)(uint32_t first_input, uint32_t number_of_inputs);
+	int quiet; // kernel prints to stdout, it is redirected to /dev/null while timing
+} MICROBENCH_KERNEL;
 
-FILE* CreateResultFile(struct tm tm)
+typedef struct MICROBENCH_RESULT
 {
-	mkdir("records", 0777); // create a directory for output files 
+	double median; // nanoseconds per input
+	double mean; // nanoseconds per input, outliers excluded
+	uint32_t outliers;
+} MICROBENCH_RESULT;
 
-	char file_path_string[30];
-	
-	strftime(file_path_string, 30, "records/%Y_%b_%d_%H_%M_%S\0", &tm);
-	printf("Creating a result file in: %s\n", file_path_string);
-	FILE *result_file = fopen(file_path_string, "a+");
-	fprintf(result_file, "time temperature humidity dew_point\n");
-	return result_file;
-}
+static uint8_t microbench_checksum_data[MICROBENCH_BATCH_SIZE][3];
+static uint16_t microbench_raw_values[MICROBENCH_BATCH_SIZE];
+static float microbench_temperatures[MICROBENCH_BATCH_SIZE];
+static float microbench_humidities[MICROBENCH_BATCH_SIZE];
+static SHTW1_SENSOR microbench_sensors[MAX_NUMBER_OF_SENSORS];
+static char microbench_names[MICROBENCH_BATCH_SIZE][16];
+static char microbench_record_lines[MICROBENCH_BATCH_SIZE][MAX_RECORD_LINE_LENGTH];
+static int microbench_record_lengths[MICROBENCH_BATCH_SIZE];
+static SHTW1_SENSOR microbench_loaded_sensors[MAX_NUMBER_OF_SENSORS]; // LoadConfiguration output, names are freed after every run
+static char * microbench_configuration_paths[2]; // single sensor configuration and MICROBENCH_BATCH_SIZE sensors configuration
+static SHTW1_SENSOR microbench_history_sensors[2]; // AddToHistory input and a history filled for the queries
+static volatile float microbench_sink; // keeps the compiler from removing the benchmarked calls
 
-void PrintResultPlots(struct tm tm)
+void MicrobenchVerifyChecksum(uint32_t first_input, uint32_t number_of_inputs)
 {
-	char file_path_string[30];	
-	strftime(file_path_string, 30, "records/%Y_%b_%d_%H_%M_%S\0", &tm);
+	int result = 0;
+	while (number_of_inputs--) result += VerifyChecksum(microbench_checksum_data[first_input + number_of_inputs], 2, microbench_checksum_data[first_input + number_of_inputs][2]);
+	microbench_sink = result;
+}
 
-	FILE *gnuplot= popen("gnuplot", "w");
-	
-	fprintf(gnuplot, "set terminal x11 size 800,800\n");
-	fprintf(gnuplot, "set title 'Measurement plots of all measured points.'\n");
-	fprintf(gnuplot, "set multiplot layout 3,1 rowsfirst\n");
+void MicrobenchConvertTemperature(uint32_t first_input, uint32_t number_of_inputs)
+{
+	float result = 0.0;
+	while (number_of_inputs--) result += ConvertTemperature(microbench_raw_values[first_input + number_of_inputs]);
+	microbench_sink = result;
+}
 
-	fprintf(gnuplot, "set title 'Temperature plot.'\n");				
-	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot, "set ylabel 'Temperature [*C]' rotate\n");
-	fprintf(gnuplot, "plot '%s' using 1:2 title 'temperature' with lines\n", file_path_string);
-	
-	fprintf(gnuplot, "set title 'Relative Humidity plot.'\n");
-	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot, "set ylabel 'RH[%]' rotate\n");
-	fprintf(gnuplot, "plot '%s' using 1:3 title 'humidity' with lines\n", file_path_string);
+void MicrobenchConvertHumidity(uint32_t first_input, uint32_t number_of_inputs)
+{
+	float result = 0.0;
+	while (number_of_inputs--) result += ConvertHumidity(microbench_raw_values[first_input + number_of_inputs]);
+	microbench_sink = result;
+}
 
-	fprintf(gnuplot, "set title 'Dew Point plot.'\n");
-	fprintf(gnuplot, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot, "set ylabel 'Dew_Point[*C]' rotate\n");
-	fprintf(gnuplot, "plot '%s' using 1:4 title 'dew_point' with lines\n", file_path_string);
+void MicrobenchCalculateDewPoint(uint32_t first_input, uint32_t number_of_inputs)
+{
+	float result = 0.0;
+	while (number_of_inputs--) result += CalculateDewPoint(microbench_temperatures[first_input + number_of_inputs], microbench_humidities[first_input + number_of_inputs]);
+	microbench_sink = result;
+}
 
-	fprintf(gnuplot, "unset multiplot\n");	
-	fflush(gnuplot);
+void MicrobenchFormatRecordLine(uint32_t first_input, uint32_t number_of_inputs)
+{
+	char record_line[MAX_RECORD_LINE_LENGTH];
+	int result = 0;
+	while (number_of_inputs--) result += FormatRecordLine(record_line, 123.45, &microbench_sensors[first_input + number_of_inputs]);
+	microbench_sink = result;
 }
 
-void UpdatePlots(struct tm tm, FILE *gnuplot_temperature, FILE *gnuplot_humidity, FILE *gnuplot_dew_point)
+void MicrobenchCrc32c(uint32_t first_input, uint32_t number_of_inputs)
 {
-	char file_path_string[30];	
-	strftime(file_path_string, 30, "records/%Y_%b_%d_%H_%M_%S\0", &tm);
-	
-	fprintf(gnuplot_temperature, "set terminal x11 size 800,300\n");
-	fprintf(gnuplot_temperature, "set title 'Temperature plot.'\n");				
-	fprintf(gnuplot_temperature, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot_temperature, "set ylabel 'Temperature [*C]' rotate\n");
-	fprintf(gnuplot_temperature, "set yrange [-40:100]\n");	
-	fprintf(gnuplot_temperature, "plot '<tail -n %i %s' using 1:2 title 'temperature' with lines\n", NUMBER_OF_PLOT_POINTS, file_path_string);
-	fprintf(gnuplot_temperature, "set xrange [GPVAL_DATA_X_MIN:GPVAL_DATA_X_MAX]\n");
-	fprintf(gnuplot_temperature, "replot\n");
-	fflush(gnuplot_temperature);
-	
-	fprintf(gnuplot_humidity, "set terminal x11 size 800,300\n");		
-	fprintf(gnuplot_humidity, "set title 'Relative Humidity plot.'\n");
-	fprintf(gnuplot_humidity, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot_humidity, "set ylabel 'RH[%]' rotate\n");
-	fprintf(gnuplot_humidity, "set yrange [-0:100]\n");	
-	fprintf(gnuplot_humidity, "plot '<tail -n %i %s' using 1:3 title 'humidity' with lines\n", NUMBER_OF_PLOT_POINTS, file_path_string);
-	fprintf(gnuplot_humidity, "set xrange [GPVAL_DATA_X_MIN:GPVAL_DATA_X_MAX]\n");
-	fprintf(gnuplot_humidity, "replot\n");
-	fflush(gnuplot_humidity);
-	
-	fprintf(gnuplot_dew_point, "set terminal x11 size 800,300\n");
-	fprintf(gnuplot_dew_point, "set title 'Dew Point plot.'\n");
-	fprintf(gnuplot_dew_point, "set xlabel 'Time[s]'\n");
-	fprintf(gnuplot_dew_point, "set ylabel 'Dew_Point[*C]' rotate\n");
-	fprintf(gnuplot_dew_point, "set yrange [-40:100]\n");
-	fprintf(gnuplot_dew_point, "plot '<tail -n %i %s' using 1:4 title 'dew_point' with lines\n", NUMBER_OF_PLOT_POINTS, file_path_string);
-	fprintf(gnuplot_dew_point, "set xrange [GPVAL_DATA_X_MIN:GPVAL_DATA_X_MAX]\n");
-	fprintf(gnuplot_dew_point, "replot\n");
-	fflush(gnuplot_dew_point);
+	// block checksum of the record store, one record line per input
+	uint32_t crc = 0;
+	while (number_of_inputs--) crc = Crc32c(crc, microbench_record_lines[first_input + number_of_inputs], microbench_record_lengths[first_input + number_of_inputs]);
+	microbench_sink = crc;
 }
 
-int InitializeSticksAndSensors(IOWKIT_HANDLE handles_table[], unsigned long number_of_devices, SHTW1_SENSOR sensors_table[], uint8_t number_of_sensors)
+void MicrobenchLoadConfiguration(uint32_t first_input, uint32_t number_of_inputs)
 {
-	int sensor_id = -1;
-	uint8_t sensors_iterator = 0;
+	// single: configuration file with one sensor, batch: one file with MICROBENCH_BATCH_SIZE sensors
+	uint16_t number_of_sensors = 0;
+	char * configuration_path = options.configuration_path;
+	(void)first_input; // every run loads the same file
+	options.configuration_path = microbench_configuration_paths[number_of_inputs > 1];
+	LoadConfiguration(microbench_loaded_sensors, &number_of_sensors);
+	ReleaseConfiguration(microbench_loaded_sensors, number_of_sensors);
+	options.configuration_path = configuration_path;
+	microbench_sink = number_of_sensors;
+}
 
-	printf("\nThere could be maximum of %u io-warrior devices connected to this PC.\n", IOWKIT_MAX_DEVICES);
-	printf("There are %u io-warrior USB Stick devices connected to this PC.\n", number_of_devices);	
-	
-	while (number_of_devices)
+void MicrobenchAddToHistory(uint32_t first_input, uint32_t number_of_inputs)
+{
+	// one sample per second, so the minute buckets roll over as in a measurement
+	SHTW1_SENSOR * sensor = &microbench_history_sensors[0];
+	while (number_of_inputs--)
 	{
-		number_of_devices--;		
-		printf("\n-- USB Stick Device %u ------------------------------------\n", number_of_devices);
-		printf("S/N (dec) of the io-warrior device at: %u\n",GetUsbStickSerialNumber(handles_table[number_of_devices]));	
-		EnableI2c(handles_table[number_of_devices]);
-		SendSoftReset(handles_table[number_of_devices]);
-		sensor_id = GetSensorId(handles_table[number_of_devices]);
-		for(sensors_iterator = 0; sensors_iterator < number_of_sensors; sensors_iterator++)
-		{
-			if (sensors_table[sensors_iterator].stick_serial_number == GetUsbStickSerialNumber(handles_table[number_of_devices]))
-			{				
-				if (sensor_id == 7)
-				{
-					printf("Found SHTW1/SHTC1 sensor connected to this device!\n");
-					sensors_table[sensors_iterator].usb_stick_handle = handles_table[number_of_devices];
-					strncpy(sensors_table[sensors_iterator].info, "OK: USB Stick and Physical Sensor found!\0", MAX_SENSOR_INFO_LENGTH);
-					printf("Bound USB STICK with a Sensor!\n");
-				}
-
-				else if (sensor_id == -1)
-				{
-					printf("Could not connect to any sensor with this device, probably sensor is missing!\n");
-					strncpy(sensors_table[sensors_iterator].info, "ERROR: Physical Sensor not found!\0", MAX_SENSOR_INFO_LENGTH);
-				}
-		
-				else
-				{
-					printf("Found unknown sensor with ID: %i\n", sensor_id);
-					strncpy(sensors_table[sensors_iterator].info, "ERROR: Unknown Physical Sensor found!\0", MAX_SENSOR_INFO_LENGTH);
-				}
+		sensor->sample_time += 1.0;
+		sensor->temperature = microbench_temperatures[first_input + number_of_inputs];
+		sensor->humidity = microbench_humidities[first_input + number_of_inputs];
+		AddToHistory(sensor);
+	}
+	microbench_sink = sensor->history ? sensor->history->raw_count : 0;
+}
 
-				break;
-			}
-		}
-		printf("----------------------------------------------------------\n\n");		
-	}	
+void MicrobenchQueryHistoryAggregate(uint32_t first_input, uint32_t number_of_inputs)
+{
+	// windows of 1 to 64 minutes ending at the newest sample, from the raw samples or the minute buckets
+	SHTW1_SENSOR * sensor = &microbench_history_sensors[1];
+	HISTORY_BUCKET aggregate;
+	float result = 0.0;
+	while (number_of_inputs--)
+	{
+		QueryHistoryAggregate(sensor, sensor->sample_time - 60.0 * (1 + (first_input + number_of_inputs) % 64), sensor->sample_time + 1.0, &aggregate);
+		result += aggregate.sum[0];
+	}
+	microbench_sink = result;
 }
 
-int CheckSensorsPresence(SHTW1_SENSOR sensors_table[], uint8_t number_of_sensors)
+int PrepareMicrobenchInputs(void)
 {
-	uint8_t missing_sensors_number = 0;
-	while(number_of_sensors)
+	uint32_t input = 0, sensors_iterator = 0;
+	int file_descriptor = -1;
+	FILE * configuration_file = NULL;
+	unsigned int random_state = 1;
+	char path_template[] = "/tmp/testsystem_microbench_XXXXXX";
+
+	for (input = 0; input < MICROBENCH_BATCH_SIZE; input++)
 	{
-		number_of_sensors--;
-		
-		if (!sensors_table[number_of_sensors].usb_stick_handle)
+		microbench_raw_values[input] = (uint16_t)rand_r(&random_state);
+		microbench_checksum_data[input][0] = (uint8_t)(microbench_raw_values[input] >> 8);
+		microbench_checksum_data[input][1] = (uint8_t)(microbench_raw_values[input] & 0xFF);
+		// find the valid checksum, so the benchmark follows the path of a correct measurement
+		while (VerifyChecksum(microbench_checksum_data[input], 2, microbench_checksum_data[input][2])) microbench_checksum_data[input][2]++;
+		microbench_temperatures[input] = ConvertTemperature(microbench_raw_values[input]);
+		microbench_humidities[input] = 1.0 + ConvertHumidity((uint16_t)rand_r(&random_state)) * 0.99;
+		snprintf(microbench_names[input], sizeof(microbench_names[input]), "sensor%u", input);
+		microbench_sensors[input].name = microbench_names[input];
+		microbench_sensors[input].temperature = microbench_temperatures[input];
+		microbench_sensors[input].humidity = microbench_humidities[input];
+		microbench_sensors[input].dew_point = CalculateDewPoint(microbench_temperatures[input], microbench_humidities[input]);
+		microbench_record_lengths[input] = FormatRecordLine(microbench_record_lines[input], 123.45 + input, &microbench_sensors[input]);
+	}
+	InitializeCrc32c();
+	if (AllocateHistories(microbench_history_sensors, 2)) return -1;
+	for (input = 0; input < 4 * 3600; input++)
+	{
+		microbench_history_sensors[1].sample_time = input;
+		microbench_history_sensors[1].temperature = microbench_temperatures[input % MICROBENCH_BATCH_SIZE];
+		microbench_history_sensors[1].humidity = microbench_humidities[input % MICROBENCH_BATCH_SIZE];
+		AddToHistory(&microbench_history_sensors[1]);
+	}
+
+	for (input = 0; input < 2; input++)
+	{
+		strcpy(path_template + strlen(path_template) - 6, "XXXXXX");
+		file_descriptor = mkstemp(path_template);
+		if (file_descriptor < 0 || (configuration_file = fdopen(file_descriptor, "w")) == NULL)
 		{
-			printf("ERROR: Have not found sensor: %s with USB STICK S/N (dec) %u !\n",sensors_table[number_of_sensors].name, sensors_table[number_of_sensors].stick_serial_number);
-			missing_sensors_number++;
+			printf("ERROR: Could not create a temporary configuration file for microbenchmarks!\n");
+			return -1;
 		}
+		fprintf(configuration_file, "%s\n", SENSOR_BINDING_LIST_START);
+		for (sensors_iterator = 0; sensors_iterator < (input ? MICROBENCH_BATCH_SIZE : 1); sensors_iterator++) fprintf(configuration_file, "sensor%u\t%u\n", sensors_iterator, 10001 + sensors_iterator);
+		fprintf(configuration_file, "%s\n", BINDING_LIST_STOP);
+		fclose(configuration_file);
+		microbench_configuration_paths[input] = strdup(path_template);
 	}
-	if (missing_sensors_number) return -missing_sensors_number;
 	return 0;
 }
 
-int UpdateSensorsMeasurements(SHTW1_SENSOR sensors_table[], uint8_t number_of_sensors)
+int CompareUint64(const void * a, const void * b)
 {
-	float Tn, m, T, RH, DP;
-	IOWKIT_HANDLE handle;
-	IOWKIT_SPECIAL_REPORT return_report;
-	
-	while(number_of_sensors)
+	uint64_t first = *(const uint64_t *)a, second = *(const uint64_t *)b;
+	return (first > second) - (first < second);
+}
+
+MICROBENCH_RESULT TimeMicrobenchKernel(MICROBENCH_KERNEL * kernel, uint32_t batch_size, uint64_t clock_overhead)
+{
+	static uint64_t samples[MICROBENCH_RUNS], deviations[MICROBENCH_RUNS];
+	MICROBENCH_RESULT result = {0};
+	uint64_t start, stop, median, deviation_median, sum = 0;
+	uint32_t run = 0, kept = 0;
+
+	for (run = 0; run < MICROBENCH_WARMUP_RUNS + MICROBENCH_RUNS; run++)
 	{
-		number_of_sensors--;
-		T, RH, DP = 1000;	
+		start = GetMonotonicNanoseconds();
+		kernel->run(batch_size > 1 ? 0 : run % MICROBENCH_BATCH_SIZE, batch_size);
+		stop = GetMonotonicNanoseconds();
+		if (run < MICROBENCH_WARMUP_RUNS) continue;
+		samples[run - MICROBENCH_WARMUP_RUNS] = (stop - start > clock_overhead) ? stop - start - clock_overhead : 0;
+	}
 
-		if (sensors_table[number_of_sensors].usb_stick_handle)
-		{ 
-			handle = sensors_table[number_of_sensors].usb_stick_handle;		
+	qsort(samples, MICROBENCH_RUNS, sizeof(uint64_t), CompareUint64);
+	median = samples[MICROBENCH_RUNS / 2];
+	for (run = 0; run < MICROBENCH_RUNS; run++) deviations[run] = samples[run] > median ? samples[run] - median : median - samples[run];
+	qsort(deviations, MICROBENCH_RUNS, sizeof(uint64_t), CompareUint64);
+	deviation_median = deviations[MICROBENCH_RUNS / 2];
 
-			if (WriteI2C(handle, MEASURE_T_RH_CLKSTR) != 3)
-			{
-				printf("I2C operation ERROR while writing measure command!\n");
-				return -1;
-			}
-			else
-			{			
-				return_report = ReadI2c(handle, 0x06);
-				if (!(return_report.Bytes[0] & 0x80)) 
-				{
-					// Check CRC for Temperature data - 2 bytes of the report.Bytes[]
-					if(VerifyChecksum(&return_report.Bytes[1], 2, return_report.Bytes[3]))
-					{
-					 	printf("Checksum ERROR for temperature measurement\n");
-						return -2; // Temperature measurement is a priority in this code, without it humidity is not processed
-					}
-					else
-					{			
-						T = ConvertTemperature((return_report.Bytes[1] << 8) | return_report.Bytes[2]);
-			
-						// Check CRC Humidity data - 2 bytes of the report.Bytes[]
-						if(VerifyChecksum(&return_report.Bytes[4], 2, return_report.Bytes[6])) 	
-						{			
-							printf("Checksum ERROR only for humidity measurement\n");
-							return -3;
-						}
-						else
-						{			
-							RH = ConvertHumidity((return_report.Bytes[4] << 8) | return_report.Bytes[5]);
-							if (RH > 0.0)
-							{
-								if (T > 0) 
-								{
-									Tn = T_PLUS;
-									m = M_PLUS;
-								}
-
-								else
-								{
-									Tn = T_MINUS;
-									m = M_MINUS;	
-								}
-
-								// Formula from SHT7x datasheet page 8.				
-								DP = Tn * ( logf( RH / 100.0 ) + m*T / (Tn + T) ) / ( m - logf( RH / 100.0 ) - m*T / (Tn + T) );
-							}
-							sensors_table[number_of_sensors].temperature = T;
-							sensors_table[number_of_sensors].humidity = RH;
-							sensors_table[number_of_sensors].dew_point = DP;
-							return 0;	
-						} 		
-					}				
-				}
-				return -1;
-			}
+	for (run = 0; run < MICROBENCH_RUNS; run++)
+	{
+		if ((samples[run] > median ? samples[run] - median : median - samples[run]) > MICROBENCH_OUTLIER_MADS * deviation_median) result.outliers++;
+		else
+		{
+			sum += samples[run];
+			kept++;
 		}
-	}		
+	}
+	result.median = (double)median / batch_size;
+	result.mean = kept ? (double)sum / kept / batch_size : result.median;
+	return result;
 }
 
-int PrintSensorsMeasurements(SHTW1_SENSOR sensors_table[], uint8_t number_of_sensors)
+double FindMicrobenchBaseline(FILE * baseline_file, const char * name, const char * mode)
 {
-	while (number_of_sensors)
+	char line[MAX_RECORD_LINE_LENGTH], baseline_name[MAX_RECORD_LINE_LENGTH], baseline_mode[MAX_RECORD_LINE_LENGTH];
+	double baseline = 0.0;
+
+	if (baseline_file == NULL) return 0.0;
+	rewind(baseline_file);
+	while (fgets(line, sizeof(line), baseline_file))
 	{
-		number_of_sensors--;
-		printf("   T: %.2f[*C], RH: %.2f[%], DewP: %.2f[*C] <--- %s\n", sensors_table[number_of_sensors].temperature, sensors_table[number_of_sensors].humidity, sensors_table[number_of_sensors].dew_point, sensors_table[number_of_sensors].name);
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%127s %127s %lf", baseline_name, baseline_mode, &baseline) == 3 && !strcmp(baseline_name, name) && !strcmp(baseline_mode, mode)) return baseline;
 	}
+	return 0.0;
 }
 
-int PrintVirtualSensors(SHTW1_SENSOR sensors_table[], uint8_t number_of_sensors)
+int RunMicrobenchmarks(void)
 {
-	printf("Virtual sensors list:\n");
-	while (number_of_sensors)
+	MICROBENCH_KERNEL kernels[] =
 	{
-		number_of_sensors--;
-		printf("-----------------------------------------------\n");
-		printf("Name: %s\n", sensors_table[number_of_sensors].name);
-		printf("Stick S/N: %i\n", sensors_table[number_of_sensors].stick_serial_number);
-		printf("T: %.2f\n", sensors_table[number_of_sensors].temperature);
-		printf("RH: %.2f\n", sensors_table[number_of_sensors].humidity);
-		printf("DP: %.2f\n", sensors_table[number_of_sensors].dew_point);
-		printf("Handle: %u\n", sensors_table[number_of_sensors].usb_stick_handle);
-		printf("Info: %s\n", sensors_table[number_of_sensors].info);
-		printf("-----------------------------------------------\n");
-	}
-}
+		{"VerifyChecksum", MicrobenchVerifyChecksum, 0},
+		{"ConvertTemperature", MicrobenchConvertTemperature, 0},
+		{"ConvertHumidity", MicrobenchConvertHumidity, 0},
+		{"CalculateDewPoint", MicrobenchCalculateDewPoint, 0},
+		{"FormatRecordLine", MicrobenchFormatRecordLine, 0},
+		{"Crc32c", MicrobenchCrc32c, 0},
+		{"LoadConfiguration", MicrobenchLoadConfiguration, 1},
+		{"AddToHistory", MicrobenchAddToHistory, 0},
+		{"QueryHistoryAggregate", MicrobenchQueryHistoryAggregate, 0},
+	};
+	const char * modes[] = {"single", "batch"};
+	uint32_t kernels_iterator, modes_iterator, run;
+	uint64_t clock_samples[MICROBENCH_RUNS], start;
+	int standard_output = -1, null_output = -1, regressions = 0;
+	double baseline, change;
+	MICROBENCH_RESULT result;
+	FILE * baseline_file = NULL;
+	FILE * output_file = NULL;
 
-int LoadConfiguration(SHTW1_SENSOR table_of_sensors[], uint8_t * number_of_sensors)
-{
-	FILE * config_file;
-    	char * line = NULL;
-	size_t len = 0;
-	ssize_t read;
-	uint8_t sensors_iterator, lines_iterator = 0;
-	* number_of_sensors = 0;
-	uint32_t stick_serial_number = 0;
-	int separator_index = 0;
-	char number_string[MAX_SENSOR_NAME_LENGTH];
+	if (PrepareMicrobenchInputs()) return -1;
 
-	config_file = fopen("configuration", "r");
+	if (options.microbench_baseline_path)
+	{
+		baseline_file = fopen(options.microbench_baseline_path, "r");
+		if (baseline_file == NULL) printf("ERROR: Could not open microbenchmark baseline file: %s\n", options.microbench_baseline_path);
+	}
+	if (options.microbench_output_path)
+	{
+		output_file = fopen(options.microbench_output_path, "w");
+		if (output_file == NULL) printf("ERROR: Could not create microbenchmark output file: %s\n", options.microbench_output_path);
+		else fprintf(output_file, "# kernel mode median[ns per input], generated by testsystem --microbench\n");
+	}
 
-	if (config_file == NULL)
-	{ 
-		printf("ERROR: Missing configuration file!");	
-		return -1;
+	// cost of reading the clock itself, subtracted from every single call measurement
+	for (run = 0; run < MICROBENCH_RUNS; run++)
+	{
+		start = GetMonotonicNanoseconds();
+		clock_samples[run] = GetMonotonicNanoseconds() - start;
 	}
+	qsort(clock_samples, MICROBENCH_RUNS, sizeof(uint64_t), CompareUint64);
 
-	// ignore the content until you find a starting phrase
-	while ((read = getline(&line, &len, config_file)) != -1) 
-	{		        	
-		line[read-1] = 0; // remove '\n'	
-		if (strcmp(line, SENSOR_BINDING_LIST_START) == 0) break;
-    	}
-	
-	printf("\nReading the configuration file...\n\n");
-	while ((read = getline(&line, &len, config_file)) != -1) 
-	{        
-		lines_iterator++;
-
-		if ( read < MIN_CONF_LINE_LENGTH )
-			printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u. (%i characters - too few)\n", lines_iterator, read);		
-		else if ( read > MAX_CONF_LINE_LENGTH )
-			printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u. (%i characters - too many)\n", lines_iterator, read);
-		else		
-		{		
-			read--;
-			line[read] = 0; // remove '\n'
-			if (strcmp(line, BINDING_LIST_STOP) == 0) break;
-
-			separator_index = strchr(line, SEPARATION_CHAR) - line;
-
-			if (separator_index >= read - 1)
+	printf("\n-- Microbenchmarks, %u runs after %u warmup runs, batch of %u inputs --\n", MICROBENCH_RUNS, MICROBENCH_WARMUP_RUNS, MICROBENCH_BATCH_SIZE);
+	printf("   clock overhead: %llu[ns]\n", (unsigned long long)clock_samples[MICROBENCH_RUNS / 2]);
+	printf("   %-22s %-7s %12s %12s %9s %12s %8s\n", "kernel", "mode", "median[ns]", "mean[ns]", "outliers", "baseline[ns]", "change");
+	for (kernels_iterator = 0; kernels_iterator < sizeof(kernels) / sizeof(kernels[0]); kernels_iterator++)
+	{
+		for (modes_iterator = 0; modes_iterator < 2; modes_iterator++)
+		{
+			if (kernels[kernels_iterator].quiet)
 			{
-				printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u: \"%s\"\n\t (no data after separation character <tab>)\n", lines_iterator, line);
+				fflush(stdout);
+				standard_output = dup(STDOUT_FILENO);
+				null_output = open("/dev/null", O_WRONLY);
+				dup2(null_output, STDOUT_FILENO);
+				close(null_output);
 			}
-			else if (separator_index < 0)
+			result = TimeMicrobenchKernel(&kernels[kernels_iterator], modes_iterator ? MICROBENCH_BATCH_SIZE : 1, modes_iterator ? 0 : clock_samples[MICROBENCH_RUNS / 2]);
+			if (kernels[kernels_iterator].quiet)
 			{
-				printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u: \"%s\"\n\t (missing separation character <tab>)\n", lines_iterator, line);
+				fflush(stdout);
+				dup2(standard_output, STDOUT_FILENO);
+				close(standard_output);
 			}
-			else if (separator_index == 0)
+
+			printf("   %-22s %-7s %12.2f %12.2f %9u", kernels[kernels_iterator].name, modes[modes_iterator], result.median, result.mean, result.outliers);
+			baseline = FindMicrobenchBaseline(baseline_file, kernels[kernels_iterator].name, modes[modes_iterator]);
+			if (baseline > 0)
 			{
-				printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u: \"%s\"\n\t (no data before separation character <tab>)\n", lines_iterator, line);
+				change = 100 * (result.median - baseline) / baseline;
+				if (change > MICROBENCH_REGRESSION_THRESHOLD && result.median - baseline > MICROBENCH_REGRESSION_MIN_NS)
+				{
+					printf(" %12.2f %+7.1f%% REGRESSION\n", baseline, change);
+					regressions++;
+				}
+				else printf(" %12.2f %+7.1f%%\n", baseline, change);
 			}
-			else		
-			{
-				line[separator_index] = 0;
+			else printf(" %12s %8s\n", "-", "-");
+			if (output_file) fprintf(output_file, "%s %s %.2f\n", kernels[kernels_iterator].name, modes[modes_iterator], result.median);
+		}
+	}
+	printf("----------------------------------------------------------\n");
+	if (regressions) printf("%i microbenchmark(s) slower than the baseline by more than %u%%\n", regressions, MICROBENCH_REGRESSION_THRESHOLD);
 
-				while (read > separator_index)
-				{
+	for (run = 0; run < 2; run++)
+	{
+		unlink(microbench_configuration_paths[run]);
+		free(microbench_configuration_paths[run]);
+	}
+	if (baseline_file) fclose(baseline_file);
+	if (output_file) fclose(output_file);
+	return regressions ? -1 : 0;
+}
 
-					number_string[read - separator_index - 1] = line[read];
-					read--;					
-				
-				}
-				
-				if (strtol(number_string, NULL, 10))
-				{
-					SHTW1_SENSOR new_sensor = { .temperature = 1000.0, .humidity = 1000.0, .dew_point = 1000.0, .info = "ERROR: USB Stick not found!\0" };
-					new_sensor.stick_serial_number = (uint32_t)strtol(number_string, NULL, 10);
+int RunModeBenchmark(SHTW1_SENSOR sensors_table[], uint16_t number_of_sensors, uint32_t samples)
+{
+	// back-to-back samples of the first bound sensor in every measurement mode, readout and channel selection,
+	// the rate is the upper limit of a sensor with period=0, the standard deviation of the first channel shows the repeatability
+	// then identification transactions at every I2C clock of the stick, errors at a clock show what the cabling tolerates,
+	// the periodic readout is left out, its samples come at the rate set on the part and not back to back
+	SHTW1_SENSOR * sensor = NULL;
+	SHTW1_SENSOR probe;
+	const SENSOR_DRIVER * driver;
+	IOWKIT_SPECIAL_REPORT report;
+	uint16_t temperature_raw, humidity_raw;
+	uint8_t mode, readout, channels, setting;
+	uint16_t sensors_iterator;
+	uint32_t sample, valid_samples, errors, product_id;
+	double start, elapsed, value, delta, mean, m2, transaction_time, max_transaction_time;
 
-					while (read >= 0)
-					{
+	for (sensors_iterator = 0; sensors_iterator < number_of_sensors && !sensor; sensors_iterator++)
+		if (sensors_table[sensors_iterator].usb_stick_handle) sensor = &sensors_table[sensors_iterator];
+	if (sensor == NULL)
+	{
+		printf("ERROR: There is no bound sensor to benchmark the measurement modes with.\n");
+		return -1;
+	}
 
-						new_sensor.name[read] = line[read];
-						read--;					
-				
-					}				
-					table_of_sensors[sensors_iterator] = new_sensor;
-					sensors_iterator++;
-					if (sensors_iterator >= IOWKIT_MAX_DEVICES)
-					{
-						printf("ERROR: Corrupted configuration file:\n\t too many sensor entities, system can hold only: %u\n", IOWKIT_MAX_DEVICES);
-						break;
-					}
-				}
+	driver = &sensor_drivers[sensor->driver];
+	probe = * sensor;
+	probe.readout = READOUT_POLLING;
+	driver->initialize(sensor->usb_stick_handle, &probe); // a periodic mode part takes no single shot commands
 
-				else
+	printf("\n-- Measurement modes of %s sensor %s, %u samples each --------\n", driver->name, sensor->name, samples);
+	printf("   %-10s %-17s %-8s %10s %10s %14s %6s\n", "mode", "readout", "channels", "rate[1/s]", "sample[ms]", "stddev", "errors");
+	for (mode = 0; mode < NUMBER_OF_MEASUREMENT_MODES; mode++)
+		for (readout = 0; readout < READOUT_PERIODIC; readout++)
+			for (channels = 0; channels < NUMBER_OF_CHANNEL_SELECTIONS; channels++)
+			{
+				if (!(driver->readouts & (1 << readout))) continue;
+				probe.measurement_mode = mode;
+				probe.readout = readout;
+				probe.channels = channels;
+				valid_samples = errors = 0;
+				mean = m2 = 0.0;
+				start = GetMonotonicTime();
+				for (sample = 0; sample < samples && infinite_loop_control; sample++)
 				{
-					line[separator_index] = '\t';
-					printf("ERROR: Corrupted configuration file:\n\t sensors section, line %u: \"%s\"\n", lines_iterator, line);
-					printf("\t (given decimal stick address: \"%s\" is not a decimal number!\n", number_string);
+					if (driver->trigger(&probe) != 3)
+					{
+						errors++;
+						continue;
+					}
+					if (driver->conversion_time_us(&probe)) usleep(driver->conversion_time_us(&probe));
+					report = driver->fetch(&probe);
+					if ((report.Bytes[0] & 0x80) || driver->decode(&probe, &report, &temperature_raw, &humidity_raw))
+					{
+						errors++;
+						continue;
+					}
+					value = (channels == CHANNEL_RH) ? ConvertHumidity(humidity_raw) : ConvertTemperature(temperature_raw);
+					valid_samples++;
+					delta = value - mean;
+					mean += delta / valid_samples;
+					m2 += delta * (value - mean);
 				}
+				elapsed = GetMonotonicTime() - start;
+				printf("   %-10s %-17s %-8s %10.1f %10.3f %9.3f%-5s %6u\n", measurement_mode_names[mode], readout_names[readout], channel_selection_names[channels],
+					elapsed > 0 ? valid_samples / elapsed : 0.0, sample ? elapsed / sample * 1000 : 0.0, valid_samples > 1 ? sqrt(m2 / (valid_samples - 1)) : 0.0,
+					(channels == CHANNEL_RH) ? "[%]" : "[*C]", errors);
 			}
-			
-		}			
-		
-    	}
 
-	* number_of_sensors = sensors_iterator;
+	product_id = IowKitGetProductId(sensor->usb_stick_handle);
+	printf("\n   I2C clock of the stick (product ID 0x%04X), %u identification transactions each:\n", (unsigned int)product_id, samples);
+	printf("   %-10s %14s %13s %6s\n", "clock[kHz]", "transaction[ms]", "max[ms]", "errors");
+	for (setting = 0; setting < sizeof(i2c_clock_settings) / sizeof(i2c_clock_settings[0]); setting++)
+	{
+		if (i2c_clock_settings[setting].product_id != product_id) continue;
+		EnableI2c(sensor->usb_stick_handle, i2c_clock_settings[setting].clock_khz);
+		errors = 0;
+		max_transaction_time = 0.0;
+		start = GetMonotonicTime();
+		for (sample = 0; sample < samples && infinite_loop_control; sample++)
+		{
+			transaction_time = GetMonotonicTime();
+			if (driver->identify(sensor->usb_stick_handle, sensor->stick_serial_number, sensor->i2c_address)) errors++;
+			transaction_time = GetMonotonicTime() - transaction_time;
+			if (transaction_time > max_transaction_time) max_transaction_time = transaction_time;
+		}
+		elapsed = GetMonotonicTime() - start;
+		printf("   %-10u %14.3f %13.3f %6u\n", i2c_clock_settings[setting].clock_khz, sample ? elapsed / sample * 1000 : 0.0, max_transaction_time * 1000, errors);
+	}
+	EnableI2c(sensor->usb_stick_handle, sensor->i2c_clock_khz);
+	driver->initialize(sensor->usb_stick_handle, sensor);
+	printf("----------------------------------------------------------\n");
+	return 0;
+}
+
+void PrintUsage(char * program_name)
+{
+	printf("Usage: %s [options]\n", program_name);
+	printf(" -c, --configuration <file>   configuration file (default: %s)\n", CONFIGURATION_FILE);
+	printf(" -o, --records <directory>    directory for result files (default: %s)\n", RECORDS_DIRECTORY);
+	printf(" -g, --plot-command <command> command fed with on-line plot commands (default: %s)\n", PLOT_COMMAND);
+	printf(" -p, --period <ms>            measurement delay between sweeps (default: %u)\n", MEASUREMENT_DELAY_MS);
+	printf(" -n, --sweeps <number>        stop after given number of sweeps (default: until 'CTRL' + 'c')\n");
+	printf(" -j, --bench-report <file>    write throughput, sweep latency and CPU use as JSON at exit\n");
+	printf(" -m, --microbench             run microbenchmarks of the per-sample kernels and exit\n");
+	printf(" -b, --baseline <file>        compare microbenchmark results with a baseline file\n");
+	printf(" -w, --write-baseline <file>  write microbenchmark results to a new baseline file\n");
+	printf(" -t, --trace <file>           record a Chrome trace event timeline, written at exit and on SIGUSR1\n");
+	printf(" -G, --generate-table <file>  write the configuration as a C header for a static build and exit\n");
+	printf(" -s, --shutdown-deadline <ms> time for flushing the records and closing plots and sticks at exit (default: %u)\n", SHUTDOWN_DEADLINE_MS);
+	printf(" -d, --daemon                 headless service mode, no plots and no console output per sweep,\n");
+	printf("                              readiness and watchdog heartbeats are reported to systemd (Type=notify)\n");
+	printf(" -r, --realtime <priority>    run the acquisition thread and the sweep workers under SCHED_FIFO with the given priority (1-99)\n");
+	printf(" -a, --cpu <number>           pin the acquisition thread to the given CPU, the sweep workers run on any CPU\n");
+	printf(" -l, --mlock                  lock the process memory, wake-up latency is reported before and after -r, -a, -l\n");
+	printf(" -M, --mode-bench <samples>   measure the sample rate of every measurement mode on the first bound sensor and exit\n");
+	printf(" -S, --control-socket <path>  serve commands on a UNIX socket ('@' = abstract), \"help\" lists them,\n");
+	printf("                              only the same user and root may connect, plot snapshots go to the records directory\n");
+	printf(" -W, --workers <layout>       threads sweeping the sticks: single (default, the acquisition thread), stick (one per stick),\n");
+	printf("                              topology (grouped by USB controller and hub read from sysfs, at most -H per hub)\n");
+	printf(" -H, --hub-workers <number>   sweep workers per USB hub of the topology layout (default: %u)\n", HUB_MAX_WORKERS);
+	printf(" -U, --usb-sysfs <directory>  USB devices in sysfs read by the topology layout (default: %s)\n", USB_SYSFS_DEVICES);
+	printf(" -h, --help                   print this help\n");
+	printf("The configuration file is reloaded on SIGHUP and whenever it is written, without stopping the measurements.\n");
+#ifdef STATIC_CONFIGURATION
+	printf("Built with the configuration from: %s, it is used unless a configuration file is given.\n", STATIC_CONFIGURATION_SOURCE);
+#endif
+}
 
-    	fclose(config_file);
-    	if (line)
-        	free(line);
-    	return 0;
+int ParseOptions(int argc, char* argv[])
+{
+	int option;
+	static struct option long_options[] =
+	{
+		{"configuration", required_argument, 0, 'c'},
+		{"records", required_argument, 0, 'o'},
+		{"plot-command", required_argument, 0, 'g'},
+		{"period", required_argument, 0, 'p'},
+		{"sweeps", required_argument, 0, 'n'},
+		{"bench-report", required_argument, 0, 'j'},
+		{"microbench", no_argument, 0, 'm'},
+		{"baseline", required_argument, 0, 'b'},
+		{"write-baseline", required_argument, 0, 'w'},
+		{"trace", required_argument, 0, 't'},
+		{"generate-table", required_argument, 0, 'G'},
+		{"shutdown-deadline", required_argument, 0, 's'},
+		{"daemon", no_argument, 0, 'd'},
+		{"realtime", required_argument, 0, 'r'},
+		{"cpu", required_argument, 0, 'a'},
+		{"mlock", no_argument, 0, 'l'},
+		{"mode-bench", required_argument, 0, 'M'},
+		{"control-socket", required_argument, 0, 'S'},
+		{"workers", required_argument, 0, 'W'},
+		{"hub-workers", required_argument, 0, 'H'},
+		{"usb-sysfs", required_argument, 0, 'U'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+#ifdef STATIC_CONFIGURATION
+	options.built_in_configuration = 1;
+#endif
+	while ((option = getopt_long(argc, argv, "c:o:g:p:n:j:mb:w:t:G:s:dr:a:lM:S:W:H:U:h", long_options, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 'c': options.configuration_path = optarg; options.built_in_configuration = 0; break;
+			case 'o': options.records_directory = optarg; break;
+			case 'g': options.plot_command = optarg; break;
+			case 'p': options.measurement_delay_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'n': options.number_of_sweeps = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'j': options.bench_report_path = optarg; break;
+			case 'm': options.microbench = 1; break;
+			case 'b': options.microbench_baseline_path = optarg; break;
+			case 'w': options.microbench_output_path = optarg; break;
+			case 't': options.trace_path = optarg; break;
+			case 'G': options.generated_table_path = optarg; options.built_in_configuration = 0; break;
+			case 's': options.shutdown_deadline_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'd': options.daemon = 1; break;
+			case 'r':
+				options.realtime_priority = atoi(optarg);
+				if (options.realtime_priority < sched_get_priority_min(SCHED_FIFO) || options.realtime_priority > sched_get_priority_max(SCHED_FIFO))
+				{
+					printf("ERROR: SCHED_FIFO priority must be from %i to %i.\n", sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+					return -1;
+				}
+				break;
+			case 'a': options.cpu = atoi(optarg); break;
+			case 'l': options.lock_memory = 1; break;
+			case 'M': options.mode_bench_samples = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'S': options.control_socket_path = optarg; break;
+			case 'W':
+				for (options.worker_layout = 0; options.worker_layout < NUMBER_OF_WORKER_LAYOUTS && strcmp(optarg, worker_layout_names[options.worker_layout]); options.worker_layout++);
+				if (options.worker_layout == NUMBER_OF_WORKER_LAYOUTS)
+				{
+					printf("ERROR: Unknown worker layout: %s, expected single, stick or topology.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'H':
+				options.hub_workers = (uint32_t)strtoul(optarg, NULL, 10);
+				if (!options.hub_workers)
+				{
+					printf("ERROR: A hub needs at least one sweep worker.\n");
+					return -1;
+				}
+				break;
+			case 'U': options.usb_sysfs_path = optarg; break;
+			case 'h': PrintUsage(argv[0]); exit(0);
+			default: PrintUsage(argv[0]); return -1;
+		}
+	}
+	return 0;
 }
 
 int main(int argc, char* argv[]) 
 {	
 	int i = UPDATE_ITERATION_NUMBER;
-	uint8_t number_of_sensors = 0;
+	uint16_t number_of_sensors = 0;
 
-	IOWKIT_HANDLE handles_table[IOWKIT_MAX_DEVICES];
+	IOWKIT_HANDLE * handles_table = NULL;
+	uint32_t * stick_serial_numbers = NULL;
+	int inotify_descriptor = -1;
+	int signal_descriptor = -1;
+	double watchdog_interval = 0.0, next_heartbeat = 0.0, wait_deadline = 0.0;
 
-	SHTW1_SENSOR table_of_sensors[IOWKIT_MAX_DEVICES];
+#ifdef STATIC_CONFIGURATION
+	static SHTW1_SENSOR table_of_sensors[MAX_NUMBER_OF_SENSORS] = STATIC_SENSORS_TABLE;
+#else
+	static SHTW1_SENSOR table_of_sensors[MAX_NUMBER_OF_SENSORS];
+#endif
+
+	if (ParseOptions(argc, argv)) return -1;
+
+	if (options.microbench) return RunMicrobenchmarks();
+
+	bench_statistics.configuration_load_time = GetMonotonicTime();
+#ifdef STATIC_CONFIGURATION
+	if (options.built_in_configuration)
+	{
+		number_of_sensors = STATIC_NUMBER_OF_SENSORS;
+		printf("\nUsing the built-in configuration from: %s\n\n", STATIC_CONFIGURATION_SOURCE);
+	}
+	else
+#endif
+	if (LoadConfiguration(&table_of_sensors[0], &number_of_sensors)) return -1;
+	bench_statistics.configuration_load_time = GetMonotonicTime() - bench_statistics.configuration_load_time;
 
-	LoadConfiguration(&table_of_sensors[0], &number_of_sensors);
+	if (options.generated_table_path)
+	{
+		i = GenerateSensorTable(options.generated_table_path, &table_of_sensors[0], number_of_sensors);
+		ReleaseConfiguration(&table_of_sensors[0], number_of_sensors);
+		return i;
+	}
 
-	uint8_t retry_counter, device_counter = 0;
+	uint8_t retry_counter = 0;
+	uint32_t number_of_recoveries = 0;
+	unsigned long device_counter = 0;
 	
 	signal(SIGINT, InterruptHandler);
+	signal(SIGTERM, InterruptHandler);
+	signal(SIGPIPE, SIG_IGN); // a plot process that died must not terminate the measurements
+	signal(SIGUSR1, TraceDumpHandler);
+	signal(SIGHUP, ReloadHandler);
+	if (options.daemon)
+	{
+		setvbuf(stdout, NULL, _IOLBF, 0); // the journal gets every line as it is printed
+		signal_descriptor = OpenSignalDescriptor();
+		watchdog_interval = GetWatchdogInterval();
+	}
+
+	trace_start = GetMonotonicNanoseconds();
+	SetTraceThreadName("acquisition");
 
 	time_t t = time(NULL);
 
 	struct tm tm = *localtime(&t);
 
-	FILE * result_file = CreateResultFile(tm);
+	RECORD_STORE records;
+
+	InitializeCrc32c();
+	if (OpenRecordStore(&records, tm)) return -1;
 	
-	FILE * gnuplot_temperature = popen("gnuplot", "w");
+	PLOT_PROCESS plots[NUMBER_OF_PLOTS] = { { NULL, -1 }, { NULL, -1 }, { NULL, -1 } };
 
-	FILE * gnuplot_humidity = popen("gnuplot", "w");
+	uint8_t plot = 0;
 
-	FILE * gnuplot_dew_point = popen("gnuplot", "w");
+	for (plot = 0; plot < NUMBER_OF_PLOTS && !options.daemon; plot++) OpenPlotProcess(&plots[plot], options.plot_command);
+	if (plots[PLOT_TEMPERATURE].pipe && plots[PLOT_HUMIDITY].pipe && plots[PLOT_DEW_POINT].pipe) StartPlotWriter(plots);
 
-	struct timespec start, stop;
+	int exit_status = 0;
 
 	double iteration_time = 0.0;
+
+	double sweep_start, phase_start;
+
+	uint32_t sweeps_counter = 0;
+
+	int records_number = 0;
+
+	int sweep_result = 0;
+
+	uint64_t sweep_trace_start = 0;
 	
-	handles_table[0] = IowKitOpenDevice(); // Get first io-warrior device handle which was found in the system
+	bench_statistics.discovery_time = GetMonotonicTime();
 
-	IOWKIT_HANDLE handle = handles_table[0];
+	StartUsbWatchdog();
+	IOWKIT_HANDLE handle = IowKitOpenDevice(); // Get first io-warrior device handle which was found in the system
 
 	if(handle != NULL)
 	{
 		unsigned long number_of_devices = IowKitGetNumDevs();
 
+		handles_table = malloc(number_of_devices * sizeof(IOWKIT_HANDLE));
+		stick_serial_numbers = malloc(number_of_devices * sizeof(uint32_t));
+		handles_table[0] = handle;
 		for (device_counter = 1; device_counter < number_of_devices; device_counter++) handles_table[device_counter] = IowKitGetDeviceHandle(device_counter + 1);
 
-		InitializeSticksAndSensors(&handles_table[0], number_of_devices, &table_of_sensors[0], number_of_sensors);
+		InitializeSticksAndSensors(&handles_table[0], &stick_serial_numbers[0], number_of_devices, &table_of_sensors[0], number_of_sensors);
+
+		bench_statistics.discovery_time = GetMonotonicTime() - bench_statistics.discovery_time;
 
 		CheckSensorsPresence(&table_of_sensors[0], number_of_sensors);		
 
 		PrintVirtualSensors(&table_of_sensors[0], number_of_sensors);		
-		
-		printf("(to stop measurements press 'CTRL' + 'c')\n");
-		
-		clock_gettime(CLOCK_REALTIME, &start);
 
-		UpdateSensorsMeasurements(&table_of_sensors[0], number_of_sensors);
+		if (options.mode_bench_samples)
+		{
+			if (RunModeBenchmark(&table_of_sensors[0], number_of_sensors, options.mode_bench_samples)) exit_status = -1;
+			infinite_loop_control = 0;
+		}
 		
-		PrintSensorsMeasurements(&table_of_sensors[0], number_of_sensors);		
+		if (!options.daemon && !options.mode_bench_samples) printf("(to stop measurements press 'CTRL' + 'c')\n");
 		
-		/*while(infinite_loop_control)
+		if (!options.built_in_configuration) inotify_descriptor = WatchConfiguration();
+		if (options.control_socket_path) OpenControlSocket(options.control_socket_path);
+		SetRealtimeScheduling();
+		SetTimeAnchor();
+		bench_statistics.measurement_start = GetMonotonicTime();
+		if (options.daemon)
 		{
-		
-			if (!UpdateSensorsMeasurements(&table_of_sensors[0], number_of_sensors))
+			printf("Measuring %u sensors as a daemon.\n", number_of_sensors);
+			NotifyServiceManager("READY=1\nSTATUS=Measuring");
+			next_heartbeat = bench_statistics.measurement_start;
+		}
+
+		while(infinite_loop_control && (!options.number_of_sweeps || sweeps_counter < options.number_of_sweeps))
+		{
+			sweep_trace_start = TraceStart();
+			sweep_start = GetMonotonicTime();
+			number_of_recoveries = bench_statistics.number_of_recoveries;
+			PROBE2(sweep_start, sweeps_counter, number_of_sensors);
+
+			sweep_result = UpdateSensorsMeasurements(&table_of_sensors[0], number_of_sensors);
+			phase_start = GetMonotonicTime();
+			EvaluateVirtualSensors(&table_of_sensors[0], number_of_sensors);
+			MarkSweepPhase(PHASE_CONVERSION, phase_start);
+			PROBE2(sweep_done, sweeps_counter, sweep_result);
+			TraceEvent(TRACE_SWEEP, sweep_trace_start, sweeps_counter);
+
+			if (!sweep_result)
 			{		
-				clock_gettime(CLOCK_REALTIME, &stop);
-				iteration_time = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec)/1000000000;
-				//printf("    T: %.2f[*C], RH: %.2f[%], DewP: %.2f[*C], Time: %.2f[s]\r", temperature, humidity, dew_point, iteration_time);
-				fflush(stdout);
-				//fprintf(result_file, "%0.2f %0.2f %0.2f %0.2f\n", iteration_time, temperature, humidity, dew_point);
-				fflush(result_file);
+				phase_start = GetMonotonicTime();
+				iteration_time = GetRecordTime(phase_start);
+				records_number = WriteResultRecords(&records, &table_of_sensors[0], number_of_sensors);
+				bench_statistics.number_of_samples += records_number;
+				bench_statistics.number_of_bound_sensors = records_number;
+				phase_start = MarkSweepPhase(PHASE_RECORD_WRITE, phase_start);
 				
-				if(i<=0)
+				if (!options.daemon)
 				{
-					i = UPDATE_ITERATION_NUMBER;					
-					//UpdatePlots(tm, gnuplot_temperature, gnuplot_humidity, gnuplot_dew_point);
+					if(i<=0)
+					{
+						i = UPDATE_ITERATION_NUMBER;					
+						if (plot_writer.running) UpdatePlots(&table_of_sensors[0], number_of_sensors);
+					}
+					i--;
+					phase_start = MarkSweepPhase(PHASE_PLOT_UPDATE, phase_start);
+
+					PrintSensorsMeasurements(&table_of_sensors[0], number_of_sensors);
+					printf("   Time: %.2f[s]\n", iteration_time);
+					fflush(stdout);
+					MarkSweepPhase(PHASE_CONSOLE_PRINT, phase_start);
 				}
-				i--;
+
 				retry_counter = 0;
-				usleep(MEASUREMENT_DELAY_MS * 1000);
 			}
 			
 			else
 			{
+				bench_statistics.number_of_failed_sweeps++;
 				retry_counter++;
+				if (bench_statistics.number_of_recoveries != number_of_recoveries) retry_counter = 0; // a recovered sensor gets a fresh chance
 				if (retry_counter >= I2C_RETRY_LIMIT)
 				{
 					printf("Terminating program after %u failed trials of I2C communication\n", retry_counter);	
-					return -1;
+					exit_status = -1;
+					break;
 				}
 			}
-		}*/
-	
-		fclose(result_file);			
 
-		DisableI2c(handle);
+			CloseSweepTiming(GetMonotonicTime() - sweep_start);
+			if (options.bench_report_path) AddBenchSweep(GetMonotonicTime() - sweep_start); // grows with every sweep, kept only for the report
+			sweeps_counter++;
+			if (!options.daemon && sweeps_counter % PHASE_REPORT_ITERATION_NUMBER == 0)
+			{
+				PrintSweepTiming(stdout);
+				PrintTimingAnalysis(stdout, &table_of_sensors[0], number_of_sensors);
+				PrintSensorsHealth(stdout, &table_of_sensors[0], number_of_sensors);
+			}
+			if (GetMonotonicTime() - timing_analyzer.anchor.monotonic >= TIME_ANCHOR_PERIOD_S) SetTimeAnchor();
+
+			// event loop between sweeps: signals, configuration changes and heartbeats are handled until the next sweep is due
+			wait_deadline = GetMonotonicTime() + (retry_counter ? 0.0 : options.measurement_delay_ms / 1000.0);
+			while (1)
+			{
+				if (trace_dump_requested && options.trace_path)
+				{
+					trace_dump_requested = 0;
+					DumpTraceEvents(options.trace_path);
+				}
+
+				if (reload_requested && options.built_in_configuration)
+				{
+					reload_requested = 0;
+					printf("The configuration is built in, there is nothing to reload.\n");
+				}
+				if (ConfigurationChanged(inotify_descriptor) || reload_requested)
+				{
+					reload_requested = 0;
+					ReloadConfiguration(&table_of_sensors[0], &number_of_sensors, &handles_table[0], &stick_serial_numbers[0], number_of_devices);
+				}
+
+				if (watchdog_interval > 0.0 && GetMonotonicTime() >= next_heartbeat)
+				{
+					NotifyServiceManager("WATCHDOG=1");
+					next_heartbeat = GetMonotonicTime() + watchdog_interval;
+				}
+
+				ServeControlSocket(&table_of_sensors[0], number_of_sensors);
+
+				if (usb_watchdog.reopen_requested) ReopenSticks(&handles_table, &stick_serial_numbers, &number_of_devices, &table_of_sensors[0], number_of_sensors);
+
+				if (!infinite_loop_control || GetMonotonicTime() >= wait_deadline) break;
+				WaitForEvents(signal_descriptor, inotify_descriptor, (watchdog_interval > 0.0 && next_heartbeat < wait_deadline) ? next_heartbeat : wait_deadline);
+			}
+		}
+
+		if (options.daemon) NotifyServiceManager("STOPPING=1");
+		bench_statistics.measurement_stop = GetMonotonicTime();
+		PrintTimingAnalysis(stdout, &table_of_sensors[0], number_of_sensors);
+		PrintSensorsHealth(stdout, &table_of_sensors[0], number_of_sensors);
+		if (options.bench_report_path) WriteBenchReport(options.bench_report_path, &table_of_sensors[0], number_of_sensors);
+		if (options.trace_path) DumpTraceEvents(options.trace_path);
+
+		if (options.control_socket_path) CloseControlSocket(options.control_socket_path, GetMonotonicTime() + options.shutdown_deadline_ms / 1000.0);
+		StopSweepWorkers();
+		StopUsbWatchdog();
+		if (ShutdownAcquisition(&records, plots, &handles_table[0], number_of_devices, &table_of_sensors[0], number_of_sensors)) exit_status = -1;
 
-		//PrintResultPlots(tm);
+		//PrintResultPlots(tm, &table_of_sensors[0], number_of_sensors);
 
 		//printf("\n(to terminate the program press 'ENTER')\n");
 
 		//getchar();
 		
 	}
-	else 	printf("No device found!");
+	else
+	{
+		printf("No device found!");
+		StopUsbWatchdog();
+		if (ShutdownAcquisition(&records, plots, NULL, 0, &table_of_sensors[0], number_of_sensors)) exit_status = -1;
+	}
 
-	IowKitCloseDevice(handle);
+	free(handles_table);
+	free(stick_serial_numbers);
+	if (inotify_descriptor >= 0) close(inotify_descriptor);
+	if (signal_descriptor >= 0) close(signal_descriptor);
+	ReleaseConfiguration(&table_of_sensors[0], number_of_sensors);
 
 	printf("\nBye bye!\n");
 
-	return 0;
+	return exit_status;
 }